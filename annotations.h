@@ -0,0 +1,90 @@
+#ifndef ANNOTATIONS_H
+#define ANNOTATIONS_H
+
+#include <QString>
+#include <QVector>
+#include <QMetaType>
+
+// Annotations of one topic made at once, as columns: one time per annotation, and the values
+// in the column of their type. Arrays all have the same length and are packed one after the
+// other, so that annotating many messages never boxes their values one by one.
+struct Annotations
+{
+	enum Type {
+		BOOL,
+		INT,
+		DOUBLE,
+		STRING,
+		INT_ARRAY,
+		DOUBLE_ARRAY
+	};
+
+	Annotations():
+		type(BOOL),
+		length(1)
+	{
+	}
+
+	int size() const { return times.size(); }
+	bool isEmpty() const { return times.isEmpty(); }
+	bool isArray() const { return type == INT_ARRAY || type == DOUBLE_ARRAY; }
+
+	// Returns whether the column of the type holds length values per annotation
+	bool isValid() const {
+		const qint64 expected = static_cast<qint64>(size()) * (isArray() ? length : 1);
+		switch (type) {
+		case BOOL:
+		case INT:
+		case INT_ARRAY:
+			return length >= 0 && ints.size() == expected;
+		case DOUBLE:
+		case DOUBLE_ARRAY:
+			return length >= 0 && doubles.size() == expected;
+		case STRING:
+			return strings.size() == expected;
+		}
+		return false;
+	}
+
+	Type type;
+	QVector<uint64_t> times;
+	// Values of BOOL, INT and INT_ARRAY annotations, bools being 0 or 1
+	QVector<qint32> ints;
+	// Values of DOUBLE and DOUBLE_ARRAY annotations
+	QVector<double> doubles;
+	QVector<QString> strings;
+	// Number of elements of each array
+	int length;
+};
+
+Q_DECLARE_METATYPE(Annotations)
+
+// Column of Annotations holding the values of timelines of T
+template<class T>
+struct AnnotationColumn;
+
+template<>
+struct AnnotationColumn<bool>
+{
+	static const QVector<qint32> &of(const Annotations &annotations) { return annotations.ints; }
+};
+
+template<>
+struct AnnotationColumn<int>
+{
+	static const QVector<qint32> &of(const Annotations &annotations) { return annotations.ints; }
+};
+
+template<>
+struct AnnotationColumn<double>
+{
+	static const QVector<double> &of(const Annotations &annotations) { return annotations.doubles; }
+};
+
+template<>
+struct AnnotationColumn<QString>
+{
+	static const QVector<QString> &of(const Annotations &annotations) { return annotations.strings; }
+};
+
+#endif // ANNOTATIONS_H
@@ -0,0 +1,477 @@
+#include "annotationwriter.h"
+#include "baglock.h"
+#include "indexcache.h"
+
+#include <rosbag/bag.h>
+
+#include <std_msgs/Bool.h>
+#include <std_msgs/Int32.h>
+#include <std_msgs/Float64.h>
+#include <std_msgs/String.h>
+#include <std_msgs/Int32MultiArray.h>
+#include <std_msgs/Float64MultiArray.h>
+
+#include <QDataStream>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QReadLocker>
+#include <QWriteLocker>
+#include <QDebug>
+
+#include <unistd.h>
+
+#include <algorithm>
+
+static const char *SUFFIX = ".annotator-journal";
+static const char *PROGRESS_SUFFIX = ".annotator-progress";
+
+static const quint32 MAGIC = 0x524a524e;
+static const quint32 VERSION = 3;
+static const quint32 PROGRESS_MAGIC = 0x524a5052;
+
+// Writes the annotation at row, whose array elements start at row * length
+static void writeMessage(rosbag::Bag &bag, const std::string &topic, const Annotations &annotations, int row) {
+	ros::Time time;
+	time.fromNSec(annotations.times[row]);
+
+	const int first = row * annotations.length;
+
+	switch (annotations.type) {
+	case Annotations::BOOL: {
+		std_msgs::Bool msg;
+		msg.data = annotations.ints[row] != 0;
+		bag.write(topic, time, msg);
+		break;
+	}
+	case Annotations::INT: {
+		std_msgs::Int32 msg;
+		msg.data = annotations.ints[row];
+		bag.write(topic, time, msg);
+		break;
+	}
+	case Annotations::DOUBLE: {
+		std_msgs::Float64 msg;
+		msg.data = annotations.doubles[row];
+		bag.write(topic, time, msg);
+		break;
+	}
+	case Annotations::STRING: {
+		std_msgs::String msg;
+		msg.data = annotations.strings[row].toStdString();
+		bag.write(topic, time, msg);
+		break;
+	}
+	case Annotations::INT_ARRAY: {
+		std_msgs::Int32MultiArray msg;
+		msg.data.assign(annotations.ints.constBegin() + first, annotations.ints.constBegin() + first + annotations.length);
+		bag.write(topic, time, msg);
+		break;
+	}
+	case Annotations::DOUBLE_ARRAY: {
+		std_msgs::Float64MultiArray msg;
+		msg.data.assign(annotations.doubles.constBegin() + first,
+						annotations.doubles.constBegin() + first + annotations.length);
+		bag.write(topic, time, msg);
+		break;
+	}
+	}
+}
+
+// Returns the annotations from row on
+static Annotations rowsFrom(const Annotations &annotations, int row) {
+	const int first = row * (annotations.isArray() ? annotations.length : 1);
+
+	Annotations rows;
+	rows.type = annotations.type;
+	rows.length = annotations.length;
+	rows.times = annotations.times.mid(row);
+	rows.ints = annotations.ints.mid(first);
+	rows.doubles = annotations.doubles.mid(first);
+	rows.strings = annotations.strings.mid(first);
+	return rows;
+}
+
+// Batches are journaled column by column, timestamps being written one by one since
+// QDataStream has no operator for uint64_t
+static QDataStream &operator<<(QDataStream &stream, const Annotations &annotations) {
+	stream << static_cast<qint32>(annotations.type) << static_cast<qint32>(annotations.length)
+		   << static_cast<quint32>(annotations.times.size());
+	for (uint64_t time : annotations.times) {
+		stream << static_cast<quint64>(time);
+	}
+	return stream << annotations.ints << annotations.doubles << annotations.strings;
+}
+
+static QDataStream &operator>>(QDataStream &stream, Annotations &annotations) {
+	qint32 type, length;
+	quint32 count;
+	stream >> type >> length >> count;
+	if (stream.status() != QDataStream::Ok) {
+		return stream;
+	}
+
+	annotations.type = static_cast<Annotations::Type>(type);
+	annotations.length = length;
+	annotations.times.clear();
+	for (quint32 i = 0; i < count && !stream.atEnd(); ++i) {
+		quint64 time;
+		stream >> time;
+		annotations.times.append(time);
+	}
+	stream >> annotations.ints >> annotations.doubles >> annotations.strings;
+
+	if (stream.status() == QDataStream::Ok && (annotations.size() != static_cast<int>(count) || !annotations.isValid())) {
+		stream.setStatus(QDataStream::ReadCorruptData);
+	}
+	return stream;
+}
+
+AnnotationWriter::AnnotationWriter(const QString &bagPath, QObject *parent):
+	QThread(parent),
+	mBagPath(bagPath),
+	mFlushRequested(false),
+	mStopping(false),
+	mJournalFailed(false)
+{
+	qRegisterMetaType<Annotations>();
+}
+
+void AnnotationWriter::write(const QString &topic, const Annotations &annotations) {
+	Q_ASSERT(annotations.isValid());
+
+	// Numbered once journaled
+	Batch batch;
+	batch.first = 0;
+	batch.topic = topic;
+	batch.annotations = annotations;
+
+	// A whole batch is journaled with a single sync
+	QMutexLocker locker(&mMutex);
+	mIncoming.append(batch);
+	mCondition.wakeOne();
+}
+
+void AnnotationWriter::flush() {
+	QMutexLocker locker(&mMutex);
+	mFlushRequested = true;
+	mCondition.wakeOne();
+}
+
+void AnnotationWriter::stop() {
+	QMutexLocker locker(&mMutex);
+	mStopping = true;
+	mCondition.wakeOne();
+}
+
+QString AnnotationWriter::journalPath() const {
+	return IndexCache::sidecarPath(mBagPath, SUFFIX);
+}
+
+QString AnnotationWriter::progressPath() const {
+	return IndexCache::sidecarPath(mBagPath, PROGRESS_SUFFIX);
+}
+
+void AnnotationWriter::run() {
+	QDir().mkpath(QFileInfo(journalPath()).absolutePath());
+
+	QVector<Batch> journaled;
+	recover(journaled);
+
+	// A writer that stopped while closing the bag wrote its batch if the bag was closed since
+	Progress progress = loadProgress();
+	quint64 written = progress.written;
+	if (progress.closing > written && closedSince(progress.bagSize)) {
+		written = progress.closing;
+	}
+
+	QVector<Batch> pending;
+	for (const Batch &batch : journaled) {
+		if (batch.first + batch.annotations.size() <= written) {
+			continue;
+		}
+
+		pending.append(batch);
+		emit recovered(batch.topic, batch.first < written ?
+			rowsFrom(batch.annotations, static_cast<int>(written - batch.first)) : batch.annotations);
+	}
+
+	if (progress.closing > progress.written) {
+		progress.written = progress.closing = written;
+		progress.bagSize = -1;
+		saveProgress(progress);
+	}
+
+	// Numbering resumes past both the bag and the journal
+	quint64 next = written;
+	if (!journaled.isEmpty()) {
+		next = std::max<quint64>(next, journaled.last().first + journaled.last().annotations.size());
+	}
+
+	// The recovered annotations stay in the old journal until the new one replaces it, which
+	// also drops a truncated annotation a crash may have left at its end
+	QFile file(journalPath());
+	if (!rewriteJournal(pending) || !file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+		failJournal();
+	}
+
+	// Annotations are batched from the oldest one not yet in the bag
+	QElapsedTimer pendingTimer;
+	pendingTimer.start();
+	bool flushNow = !pending.isEmpty();
+
+	QMutexLocker locker(&mMutex);
+	forever {
+		if (mIncoming.isEmpty() && !mFlushRequested && !mStopping && !flushNow) {
+			if (pending.isEmpty()) {
+				mCondition.wait(&mMutex);
+			}
+			else {
+				mCondition.wait(&mMutex, std::max<qint64>(FLUSH_INTERVAL - pendingTimer.elapsed(), 0));
+			}
+		}
+
+		QVector<Batch> incoming;
+		incoming.swap(mIncoming);
+		const bool stopping = mStopping;
+		flushNow = flushNow || mFlushRequested || stopping;
+		mFlushRequested = false;
+		locker.unlock();
+
+		if (!incoming.isEmpty()) {
+			for (Batch &batch : incoming) {
+				batch.first = next;
+				next += batch.annotations.size();
+			}
+
+			if (!journal(file, incoming)) {
+				failJournal();
+			}
+			if (pending.isEmpty()) {
+				pendingTimer.restart();
+			}
+			pending += incoming;
+
+			// Without a journal, annotations are only safe once in the bag
+			flushNow = flushNow || mJournalFailed;
+		}
+
+		if (!pending.isEmpty() && (flushNow || pendingTimer.elapsed() >= FLUSH_INTERVAL)) {
+			// Failed batches stay in the journal and are retried after the next interval,
+			// from the first annotation that did not make it to the bag
+			if (writeBag(pending, written)) {
+				pending.clear();
+				file.resize(0);
+			}
+			pendingTimer.restart();
+		}
+		flushNow = false;
+
+		locker.relock();
+		if (stopping && mIncoming.isEmpty()) {
+			break;
+		}
+	}
+}
+
+void AnnotationWriter::failJournal() {
+	if (mJournalFailed) {
+		return;
+	}
+
+	mJournalFailed = true;
+	qDebug() << "Writing annotations straight to the bag, since journal" << journalPath() << "cannot be written";
+	emit journalFailed(journalPath());
+}
+
+bool AnnotationWriter::recover(QVector<Batch> &batches) {
+	QFile file(journalPath());
+	if (!file.open(QIODevice::ReadOnly) || file.size() == 0) {
+		return false;
+	}
+
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_5_11);
+
+	quint32 magic, version;
+	stream >> magic >> version;
+	if (stream.status() != QDataStream::Ok || magic != MAGIC || version != VERSION) {
+		qDebug() << "Ignoring invalid annotation journal" << file.fileName();
+		return false;
+	}
+
+	while (!stream.atEnd()) {
+		Batch batch;
+		stream >> batch.first >> batch.topic >> batch.annotations;
+		if (stream.status() != QDataStream::Ok) {
+			qDebug() << "Ignoring truncated annotations at the end of journal" << file.fileName();
+			break;
+		}
+
+		batches.append(batch);
+	}
+
+	return true;
+}
+
+bool AnnotationWriter::rewriteJournal(const QVector<Batch> &batches) {
+	QSaveFile file(journalPath());
+	if (!file.open(QIODevice::WriteOnly) || (!batches.isEmpty() && !journal(file, batches)) || !file.commit()) {
+		qDebug() << "Could not rewrite annotation journal" << journalPath();
+		return false;
+	}
+
+	return true;
+}
+
+bool AnnotationWriter::journal(QFileDevice &file, const QVector<Batch> &batches) {
+	if (!file.isOpen() || batches.isEmpty()) {
+		return false;
+	}
+
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_5_11);
+
+	if (file.size() == 0) {
+		stream << MAGIC << VERSION;
+	}
+	for (const Batch &batch : batches) {
+		stream << batch.first << batch.topic << batch.annotations;
+	}
+
+	// Annotations only count as written once they are on disk
+	if (stream.status() != QDataStream::Ok || !file.flush() || ::fsync(file.handle()) != 0) {
+		qDebug() << "Could not write annotation journal" << file.fileName();
+		return false;
+	}
+
+	return true;
+}
+
+AnnotationWriter::Progress AnnotationWriter::loadProgress() const {
+	Progress progress;
+	progress.written = progress.closing = 0;
+	progress.bagSize = -1;
+
+	QFile file(progressPath());
+	if (!file.open(QIODevice::ReadOnly)) {
+		return progress;
+	}
+
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_5_11);
+
+	quint32 magic;
+	Progress stored;
+	stream >> magic >> stored.written >> stored.closing >> stored.bagSize;
+	if (stream.status() != QDataStream::Ok || magic != PROGRESS_MAGIC) {
+		qDebug() << "Ignoring invalid annotation progress" << file.fileName();
+		return progress;
+	}
+
+	return stored;
+}
+
+bool AnnotationWriter::saveProgress(const Progress &progress) const {
+	QSaveFile file(progressPath());
+	if (!file.open(QIODevice::WriteOnly)) {
+		qDebug() << "Could not write annotation progress" << file.fileName();
+		return false;
+	}
+
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_5_11);
+	stream << PROGRESS_MAGIC << progress.written << progress.closing << progress.bagSize;
+
+	if (stream.status() != QDataStream::Ok || !file.commit()) {
+		qDebug() << "Could not write annotation progress" << file.fileName();
+		return false;
+	}
+
+	return true;
+}
+
+bool AnnotationWriter::closedSince(qint64 bagSize) const {
+	const QFileInfo info(mBagPath);
+	if (!info.exists() || info.size() == bagSize) {
+		return false;
+	}
+
+	// A bag whose closing was interrupted has no index to be opened with
+	try {
+		rosbag::Bag bag;
+		QReadLocker locker(&BagLock::instance());
+		bag.open(mBagPath.toStdString());
+	}
+	catch (const rosbag::BagException &) {
+		return false;
+	}
+
+	return true;
+}
+
+bool AnnotationWriter::writeBag(const QVector<Batch> &batches, quint64 &written) {
+	// Batches are numbered in order, so the last one tells whether anything is left to write
+	if (batches.isEmpty() || batches.last().first + batches.last().annotations.size() <= written) {
+		return true;
+	}
+
+	// Bags are not opened while their index is rewritten
+	QWriteLocker locker(&BagLock::instance());
+
+	const QFileInfo info(mBagPath);
+	const qint64 bagSize = info.exists() ? info.size() : -1;
+	const rosbag::bagmode::BagMode mode = bagSize >= 0 ? rosbag::bagmode::Append : rosbag::bagmode::Write;
+
+	quint64 reached = written;
+	bool ok = true;
+	rosbag::Bag bag;
+
+	try {
+		bag.open(mBagPath.toStdString(), mode);
+		for (const Batch &batch : batches) {
+			const std::string topic = ("/annotation/" + batch.topic).toStdString();
+			for (int row = 0; row < batch.annotations.size(); ++row) {
+				if (batch.first + row < reached) {
+					continue;
+				}
+
+				writeMessage(bag, topic, batch.annotations, row);
+				reached = batch.first + row + 1;
+			}
+		}
+	}
+	catch (const rosbag::BagException &e) {
+		qDebug() << "An exception ocurred while writing annotations to bag:" << e.what();
+		ok = false;
+	}
+
+	// Annotations written before a failure are kept along with the index when the bag is closed
+	Progress progress;
+	progress.written = written;
+	progress.closing = reached;
+	progress.bagSize = bagSize;
+	if (reached > written) {
+		saveProgress(progress);
+	}
+
+	try {
+		bag.close();
+	}
+	catch (const rosbag::BagException &e) {
+		qDebug() << "An exception ocurred while closing bag after writing annotations:" << e.what();
+		return false;
+	}
+
+	if (reached > written) {
+		written = reached;
+		progress.written = progress.closing = reached;
+		progress.bagSize = -1;
+		ok = saveProgress(progress) && ok;
+	}
+
+	return ok;
+}
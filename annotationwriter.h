@@ -0,0 +1,99 @@
+#ifndef ANNOTATIONWRITER_H
+#define ANNOTATIONWRITER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QString>
+#include <QVector>
+
+#include "annotations.h"
+
+class QFile;
+class QFileDevice;
+
+// Writes annotations to a bag on its own thread, so that annotating never waits for the bag.
+// Annotations are first appended to a journal next to the bag and synced to disk, then
+// written to the bag in batches, every FLUSH_INTERVAL or when flush is called, the bag being
+// opened and its index rewritten once per batch. Annotations left in the journal by a crash
+// are written to the bag when a writer is next started for it, and given back through
+// recovered so that they can be shown.
+//
+// Journaled annotations are numbered one after the other, and a progress file next to the
+// journal holds the number of the first annotation not in the bag yet, from which numbering
+// also resumes. Annotations below it are never written again, whether the journal outlived
+// the batch that wrote them or the batch failed partway. Before a bag is closed, the progress
+// file records how far the batch got along with the size of the bag before it, so that a
+// writer that stops while closing the bag can tell whether the batch made it.
+class AnnotationWriter : public QThread
+{
+	Q_OBJECT
+	Q_DISABLE_COPY(AnnotationWriter)
+
+public:
+	// Milliseconds between two batches written to the bag
+	static const int FLUSH_INTERVAL = 5000;
+
+	explicit AnnotationWriter(const QString &bagPath, QObject *parent = nullptr);
+
+	const QString &bagPath() const { return mBagPath; }
+
+	// Queues annotations to be written to /annotation/<topic>
+	void write(const QString &topic, const Annotations &annotations);
+	// Writes the annotations received so far to the bag without waiting for the interval
+	void flush();
+	// Writes the remaining annotations, after which the thread finishes
+	void stop();
+
+signals:
+	// Annotations a previous writer journaled but did not write to the bag
+	void recovered(const QString &topic, const Annotations &annotations);
+	// The journal could not be written, so annotations are written to the bag right away
+	// and a crash loses those of the batch being written
+	void journalFailed(const QString &path);
+
+protected:
+	void run() override;
+
+private:
+	struct Batch {
+		// Number of the first annotation of the batch
+		quint64 first;
+		QString topic;
+		Annotations annotations;
+	};
+
+	struct Progress {
+		// Number of the first annotation not in the bag yet
+		quint64 written;
+		// Number past the last annotation of the batch being closed, if above written
+		quint64 closing;
+		// Size of the bag before that batch, -1 if it did not exist
+		qint64 bagSize;
+	};
+
+	QString journalPath() const;
+	QString progressPath() const;
+	bool recover(QVector<Batch> &batches);
+	// Replaces the journal with the given batches at once
+	bool rewriteJournal(const QVector<Batch> &batches);
+	bool journal(QFileDevice &file, const QVector<Batch> &batches);
+	Progress loadProgress() const;
+	bool saveProgress(const Progress &progress) const;
+	// Returns whether a bag that had the given size was since closed with a batch in it
+	bool closedSince(qint64 bagSize) const;
+	// Writes the annotations numbered from written on, and advances written past the last one in the bag
+	bool writeBag(const QVector<Batch> &batches, quint64 &written);
+	void failJournal();
+
+	QString mBagPath;
+
+	QMutex mMutex;
+	QWaitCondition mCondition;
+	QVector<Batch> mIncoming;
+	bool mFlushRequested;
+	bool mStopping;
+	bool mJournalFailed;
+};
+
+#endif // ANNOTATIONWRITER_H
@@ -0,0 +1,157 @@
+#include "audioenvelope.h"
+
+#include <QMutexLocker>
+
+#include <algorithm>
+#include <cmath>
+
+AudioEnvelope::AudioEnvelope(uint64_t startTime):
+	mStartTime(startTime),
+	mChannels(1),
+	mSampleRate(0)
+{
+}
+
+void AudioEnvelope::append(const qint16 *samples, int count, int channels, int sampleRate) {
+	QMutexLocker locker(&mMutex);
+
+	mChannels = std::max(channels, 1);
+	mSampleRate = sampleRate;
+
+	// Buckets span whole frames, so samples left over by a buffer wait for the next one
+	const int bucketSamples = BASE_FRAMES * mChannels;
+	const qint16 *end = samples + count;
+
+	if (!mPending.isEmpty()) {
+		const int missing = std::min<int>(bucketSamples - mPending.size(), end - samples);
+		const int size = mPending.size();
+		mPending.resize(size + missing);
+		std::copy(samples, samples + missing, mPending.begin() + size);
+		samples += missing;
+
+		if (mPending.size() < bucketSamples) {
+			return;
+		}
+
+		reduce(mPending.constData(), mPending.size());
+		mPending.clear();
+	}
+
+	for (; end - samples >= bucketSamples; samples += bucketSamples) {
+		reduce(samples, bucketSamples);
+	}
+	mPending.resize(end - samples);
+	std::copy(samples, end, mPending.begin());
+
+	mergeLevels(false);
+}
+
+void AudioEnvelope::finish() {
+	QMutexLocker locker(&mMutex);
+
+	if (!mPending.isEmpty()) {
+		reduce(mPending.constData(), mPending.size());
+		mPending.clear();
+	}
+
+	mergeLevels(true);
+}
+
+// Kept to plain loops over integers, which compilers turn into SIMD min, max and multiply-add
+// instructions without any change in rounding
+void AudioEnvelope::reduce(const qint16 *samples, int count) {
+	qint32 lo = samples[0];
+	qint32 hi = samples[0];
+	qint64 sumSquares = 0;
+
+	for (int i = 0; i < count; ++i) {
+		const qint32 sample = samples[i];
+		lo = std::min(lo, sample);
+		hi = std::max(hi, sample);
+		sumSquares += sample * sample;
+	}
+
+	if (mLevels.isEmpty()) {
+		mLevels.append(QVector<Bucket>());
+	}
+
+	mLevels[0].append({static_cast<qint16>(lo), static_cast<qint16>(hi), static_cast<quint32>(count / mChannels), static_cast<float>(sumSquares / (32768.0 * 32768.0))});
+}
+
+void AudioEnvelope::mergeLevels(bool partial) {
+	for (int level = 0; level < mLevels.size() && mLevels[level].size() > 1; ++level) {
+		const int size = mLevels[level].size();
+		const int groups = partial ? (size + FACTOR - 1) / FACTOR : size / FACTOR;
+		if (groups == 0) {
+			break;
+		}
+
+		if (level + 1 == mLevels.size()) {
+			mLevels.append(QVector<Bucket>());
+		}
+
+		// A bucket left incomplete by the previous pass is merged again with its whole group
+		QVector<Bucket> &parents = mLevels[level + 1];
+		const QVector<Bucket> &children = mLevels[level];
+		if (!parents.isEmpty() && parents.size() * FACTOR > children.size()) {
+			parents.removeLast();
+		}
+
+		while (parents.size() < groups) {
+			const int first = parents.size() * FACTOR;
+			parents.append(merge(children.constData() + first, std::min<int>(FACTOR, children.size() - first)));
+		}
+	}
+}
+
+AudioEnvelope::Bucket AudioEnvelope::merge(const Bucket *buckets, int count) {
+	Bucket merged = buckets[0];
+	for (int i = 1; i < count; ++i) {
+		merged.min = std::min(merged.min, buckets[i].min);
+		merged.max = std::max(merged.max, buckets[i].max);
+		merged.count += buckets[i].count;
+		merged.sumSquares += buckets[i].sumSquares;
+	}
+	return merged;
+}
+
+AudioEnvelope::Range AudioEnvelope::query(uint64_t start, uint64_t end, int maxBuckets) const {
+	QMutexLocker locker(&mMutex);
+
+	Range range = {start, 0, {}, {}, {}};
+	if (mSampleRate <= 0 || mLevels.isEmpty() || end <= start || maxBuckets <= 0) {
+		return range;
+	}
+
+	const double framesPerNs = 1e-9 * mSampleRate;
+	const uint64_t firstFrame = start > mStartTime ? static_cast<uint64_t>((start - mStartTime) * framesPerNs) : 0;
+	const uint64_t lastFrame = end > mStartTime ? static_cast<uint64_t>(std::ceil((end - mStartTime) * framesPerNs)) : 0;
+
+	// The finest level that fits, or the coarsest one
+	int level = 0;
+	uint64_t frames = BASE_FRAMES;
+	while (level + 1 < mLevels.size() && (lastFrame - firstFrame + frames - 1) / frames > static_cast<uint64_t>(maxBuckets)) {
+		level += 1;
+		frames *= FACTOR;
+	}
+
+	const QVector<Bucket> &buckets = mLevels[level];
+	const int first = static_cast<int>(std::min<uint64_t>(firstFrame / frames, buckets.size()));
+	const int last = static_cast<int>(std::min<uint64_t>((lastFrame + frames - 1) / frames, buckets.size()));
+	const int count = std::min(last - first, maxBuckets);
+
+	range.start = mStartTime + static_cast<uint64_t>(first * frames / framesPerNs);
+	range.duration = static_cast<uint64_t>(frames / framesPerNs);
+	range.min.resize(count);
+	range.max.resize(count);
+	range.rms.resize(count);
+
+	for (int i = 0; i < count; ++i) {
+		const Bucket &bucket = buckets[first + i];
+		range.min[i] = bucket.min / 32768.0f;
+		range.max[i] = bucket.max / 32768.0f;
+		range.rms[i] = std::sqrt(bucket.sumSquares / std::max<quint32>(bucket.count * mChannels, 1));
+	}
+
+	return range;
+}
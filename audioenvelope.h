@@ -0,0 +1,62 @@
+#ifndef AUDIOENVELOPE_H
+#define AUDIOENVELOPE_H
+
+#include <QVector>
+#include <QMutex>
+
+#include <cstdint>
+
+// Min, max and RMS of the samples of an audio topic, at zoom levels each grouping FACTOR
+// buckets of the level below, the finest one covering BASE_FRAMES frames per bucket. A range
+// of any length is then drawn from the level that has just enough buckets for it. Samples are
+// appended from the thread decoding the audio while the envelope is queried, see
+// AudioEnvelopeBuilder.
+class AudioEnvelope
+{
+public:
+	enum {
+		BASE_FRAMES = 512,
+		FACTOR = 4
+	};
+
+	struct Bucket {
+		qint16 min;
+		qint16 max;
+		quint32 count;
+		float sumSquares;
+	};
+
+	// Buckets of a query, starting at start and lasting duration each, in nanoseconds.
+	// Amplitudes are normalized to [-1, 1].
+	struct Range {
+		uint64_t start;
+		uint64_t duration;
+		QVector<float> min;
+		QVector<float> max;
+		QVector<float> rms;
+	};
+
+	explicit AudioEnvelope(uint64_t startTime);
+
+	// Channels are interleaved, all of them are folded into the same buckets
+	void append(const qint16 *samples, int count, int channels, int sampleRate);
+	// Turns samples that do not fill a bucket and buckets that do not fill a group into buckets
+	void finish();
+
+	// Returns at most maxBuckets buckets covering start to end
+	Range query(uint64_t start, uint64_t end, int maxBuckets) const;
+
+private:
+	void reduce(const qint16 *samples, int count);
+	void mergeLevels(bool partial);
+	static Bucket merge(const Bucket *buckets, int count);
+
+	mutable QMutex mMutex;
+	uint64_t mStartTime;
+	int mChannels;
+	int mSampleRate;
+	QVector<qint16> mPending;
+	QVector<QVector<Bucket>> mLevels;
+};
+
+#endif // AUDIOENVELOPE_H
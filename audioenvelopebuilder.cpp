@@ -0,0 +1,104 @@
+#include "audioenvelopebuilder.h"
+#include "audiostream.h"
+
+#include <QAudioDecoder>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QDebug>
+
+#include <algorithm>
+
+// Time between notifications of a growing envelope, in milliseconds
+static const int NOTIFY_INTERVAL = 1000;
+
+AudioEnvelopeBuilder::AudioEnvelopeBuilder(const QString &bagPath, const Envelopes &envelopes, QObject *parent):
+	QThread(parent),
+	mBagPath(bagPath),
+	mEnvelopes(envelopes),
+	mCancelled(false)
+{
+}
+
+void AudioEnvelopeBuilder::cancel() {
+	mCancelled = true;
+	quit();
+}
+
+void AudioEnvelopeBuilder::run() {
+	for (auto it = mEnvelopes.begin(); it != mEnvelopes.end() && !mCancelled; ++it) {
+		build(it.key(), **it);
+	}
+}
+
+void AudioEnvelopeBuilder::build(const QString &topic, AudioEnvelope &envelope) {
+	// Payloads are streamed from the start, the envelope maps samples to times from there
+	AudioStream stream(mBagPath, topic, 0);
+	if (!stream.open(QIODevice::ReadOnly)) {
+		return;
+	}
+
+	QAudioFormat format;
+	format.setCodec("audio/pcm");
+	format.setSampleType(QAudioFormat::SignedInt);
+	format.setSampleSize(16);
+	format.setByteOrder(QAudioFormat::Endian(QSysInfo::ByteOrder));
+
+	QAudioDecoder decoder;
+	decoder.setAudioFormat(format);
+	decoder.setSourceDevice(&stream);
+
+	QEventLoop loop;
+	QElapsedTimer notifyTimer;
+	notifyTimer.start();
+
+	connect(&decoder, &QAudioDecoder::bufferReady, [&]() {
+		if (!append(decoder.read(), envelope)) {
+			qDebug() << "Unsupported sample format for the envelope of audio topic" << topic;
+			decoder.stop();
+			loop.quit();
+		}
+		else if (notifyTimer.hasExpired(NOTIFY_INTERVAL)) {
+			emit envelopeChanged(topic);
+			notifyTimer.restart();
+		}
+	});
+	connect(&decoder, &QAudioDecoder::finished, &loop, &QEventLoop::quit);
+	connect(&decoder, static_cast<void (QAudioDecoder::*)(QAudioDecoder::Error)>(&QAudioDecoder::error), [&]() {
+		qDebug() << "Could not decode audio topic" << topic << "for its envelope:" << decoder.errorString();
+		loop.quit();
+	});
+
+	decoder.start();
+
+	// cancel() quits every event loop of the thread, this one included
+	loop.exec();
+	decoder.stop();
+
+	if (!mCancelled) {
+		envelope.finish();
+		emit envelopeChanged(topic);
+	}
+}
+
+bool AudioEnvelopeBuilder::append(const QAudioBuffer &buffer, AudioEnvelope &envelope) {
+	const QAudioFormat format = buffer.format();
+	const int channels = format.channelCount();
+
+	if (format.sampleType() == QAudioFormat::SignedInt && format.sampleSize() == 16) {
+		envelope.append(buffer.constData<qint16>(), buffer.sampleCount(), channels, format.sampleRate());
+		return true;
+	}
+
+	// Backends that ignore the requested format mostly decode to floats
+	if (format.sampleType() == QAudioFormat::Float && format.sampleSize() == 32) {
+		const float *samples = buffer.constData<float>();
+		QVector<qint16> converted(buffer.sampleCount());
+		for (int i = 0; i < converted.size(); ++i) {
+			converted[i] = static_cast<qint16>(std::max(-1.0f, std::min(samples[i], 1.0f)) * 32767.0f);
+		}
+		envelope.append(converted.constData(), converted.size(), channels, format.sampleRate());
+		return true;
+	}
+
+	return false;
+}
@@ -0,0 +1,45 @@
+#ifndef AUDIOENVELOPEBUILDER_H
+#define AUDIOENVELOPEBUILDER_H
+
+#include <QThread>
+#include <QHash>
+#include <QString>
+
+#include <atomic>
+#include <memory>
+
+#include "audioenvelope.h"
+
+class QAudioBuffer;
+
+// Decodes audio topics one after the other on its own low priority thread, streaming them
+// from the bag, and appends their samples to the envelope of each topic. Envelopes can be
+// queried while they are being built, envelopeChanged is emitted as they grow.
+class AudioEnvelopeBuilder : public QThread
+{
+	Q_OBJECT
+	Q_DISABLE_COPY(AudioEnvelopeBuilder)
+
+public:
+	typedef QHash<QString, std::shared_ptr<AudioEnvelope>> Envelopes;
+
+	AudioEnvelopeBuilder(const QString &bagPath, const Envelopes &envelopes, QObject *parent = nullptr);
+
+	void cancel();
+
+signals:
+	void envelopeChanged(const QString &topic);
+
+protected:
+	void run() override;
+
+private:
+	void build(const QString &topic, AudioEnvelope &envelope);
+	static bool append(const QAudioBuffer &buffer, AudioEnvelope &envelope);
+
+	QString mBagPath;
+	Envelopes mEnvelopes;
+	std::atomic<bool> mCancelled;
+};
+
+#endif // AUDIOENVELOPEBUILDER_H
@@ -0,0 +1,167 @@
+#include "audiostream.h"
+#include "baglock.h"
+
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+
+#include <audio_common_msgs/AudioData.h>
+
+#include <QMutexLocker>
+#include <QDebug>
+
+#include <algorithm>
+
+AudioStream::AudioStream(const QString &bagPath, const QString &topic, uint64_t start, QObject *parent):
+	QIODevice(parent),
+	mBagPath(bagPath),
+	mTopic(topic),
+	mStart(start),
+	mHead(0),
+	mFill(0),
+	mStopping(false),
+	mFinished(false)
+{
+}
+
+AudioStream::~AudioStream()
+{
+	close();
+}
+
+bool AudioStream::open(OpenMode mode) {
+	if (isOpen() || (mode & WriteOnly)) {
+		return false;
+	}
+
+	mRing.resize(CAPACITY);
+	mHead = mFill = 0;
+	mStopping = mFinished = false;
+
+	if (!QIODevice::open(mode | Unbuffered)) {
+		return false;
+	}
+
+	mReader.reset(QThread::create([this]() { readBag(); }));
+	mReader->start();
+
+	return true;
+}
+
+void AudioStream::close() {
+	if (mReader) {
+		{
+			QMutexLocker locker(&mMutex);
+			mStopping = true;
+			mNotFull.wakeAll();
+		}
+		mReader->wait();
+		mReader.reset();
+	}
+
+	mRing.clear();
+	mRing.squeeze();
+
+	QIODevice::close();
+}
+
+qint64 AudioStream::bytesAvailable() const {
+	QMutexLocker locker(&mMutex);
+	return mFill + QIODevice::bytesAvailable();
+}
+
+bool AudioStream::atEnd() const {
+	QMutexLocker locker(&mMutex);
+	return mFinished && mFill == 0;
+}
+
+qint64 AudioStream::readData(char *data, qint64 maxSize) {
+	QMutexLocker locker(&mMutex);
+
+	// Nothing is buffered yet, readyRead is emitted once the reader has caught up
+	if (mFill == 0) {
+		return mFinished ? -1 : 0;
+	}
+
+	const int size = static_cast<int>(std::min<qint64>(maxSize, mFill));
+
+	// The buffered bytes may wrap around the end of the ring
+	const int first = std::min(size, CAPACITY - mHead);
+	std::copy(mRing.constData() + mHead, mRing.constData() + mHead + first, data);
+	std::copy(mRing.constData(), mRing.constData() + size - first, data + first);
+
+	mHead = (mHead + size) % CAPACITY;
+	mFill -= size;
+	mNotFull.wakeAll();
+
+	return size;
+}
+
+qint64 AudioStream::writeData(const char *, qint64) {
+	return -1;
+}
+
+void AudioStream::readBag() {
+	try {
+		rosbag::Bag bag;
+		{
+			QReadLocker locker(&BagLock::instance());
+			bag.open(mBagPath.toStdString());
+		}
+
+		ros::Time start;
+		start.fromNSec(mStart);
+
+		rosbag::View view(bag, rosbag::TopicQuery(mTopic.toStdString()), start);
+		for (auto it = view.begin(); it != view.end(); ++it) {
+			audio_common_msgs::AudioData::ConstPtr m = it->instantiate<audio_common_msgs::AudioData>();
+			if (m && !write(reinterpret_cast<const char *>(m->data.data()), m->data.size())) {
+				return;
+			}
+		}
+	}
+	catch (const rosbag::BagException &e) {
+		qDebug() << "An exception has occured while streaming audio from bag " << mBagPath << ": " << e.what();
+	}
+
+	{
+		QMutexLocker locker(&mMutex);
+		mFinished = true;
+	}
+
+	// Lets the player read the remaining bytes and then find the end of the stream
+	emit readyRead();
+	emit readChannelFinished();
+}
+
+bool AudioStream::write(const char *data, int size) {
+	while (size > 0) {
+		int written;
+
+		{
+			QMutexLocker locker(&mMutex);
+			while (mFill == CAPACITY && !mStopping) {
+				mNotFull.wait(&mMutex);
+			}
+
+			if (mStopping) {
+				return false;
+			}
+
+			written = std::min(size, CAPACITY - mFill);
+			const int tail = (mHead + mFill) % CAPACITY;
+			const int first = std::min(written, CAPACITY - tail);
+			std::copy(data, data + first, mRing.data() + tail);
+			std::copy(data + first, data + written, mRing.data());
+
+			mFill += written;
+		}
+
+		data += written;
+		size -= written;
+
+		// Emitted from the reader thread, so the player is notified through a queued connection
+		emit readyRead();
+	}
+
+	return true;
+}
@@ -0,0 +1,58 @@
+#ifndef AUDIOSTREAM_H
+#define AUDIOSTREAM_H
+
+#include <QIODevice>
+#include <QByteArray>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThread>
+
+#include <memory>
+
+// Sequential device playing the audio of a topic from a given time onwards. A reader thread
+// instantiates the AudioData messages from the bag and copies their payloads into a ring
+// buffer of fixed capacity, waiting whenever it is full, so memory use does not depend on
+// the length of the recording. Seeking is done by opening a new stream at another time.
+class AudioStream : public QIODevice
+{
+	Q_OBJECT
+	Q_DISABLE_COPY(AudioStream)
+
+public:
+	AudioStream(const QString &bagPath, const QString &topic, uint64_t start, QObject *parent = nullptr);
+	~AudioStream();
+
+	bool open(OpenMode mode) override;
+	void close() override;
+
+	bool isSequential() const override { return true; }
+	qint64 bytesAvailable() const override;
+	bool atEnd() const override;
+
+	// Size of the ring buffer, in bytes
+	static const int CAPACITY = 256 * 1024;
+
+protected:
+	qint64 readData(char *data, qint64 maxSize) override;
+	qint64 writeData(const char *data, qint64 maxSize) override;
+
+private:
+	void readBag();
+	bool write(const char *data, int size);
+
+	QString mBagPath;
+	QString mTopic;
+	uint64_t mStart;
+
+	std::unique_ptr<QThread> mReader;
+
+	mutable QMutex mMutex;
+	QWaitCondition mNotFull;
+	QByteArray mRing;
+	int mHead;
+	int mFill;
+	bool mStopping;
+	bool mFinished;
+};
+
+#endif // AUDIOSTREAM_H
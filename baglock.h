@@ -0,0 +1,19 @@
+#ifndef BAGLOCK_H
+#define BAGLOCK_H
+
+#include <QReadWriteLock>
+
+// Appending to a bag rewrites its index in place, so a bag opened meanwhile would read an
+// index that is being overwritten. Bags are opened with this lock held for reading, and
+// AnnotationWriter holds it for writing while it appends. Bags that are already open keep
+// reading the chunks their index points to, which appending leaves untouched.
+class BagLock
+{
+public:
+	static QReadWriteLock &instance() {
+		static QReadWriteLock lock;
+		return lock;
+	}
+};
+
+#endif // BAGLOCK_H
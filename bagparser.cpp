@@ -0,0 +1,365 @@
+#include "bagparser.h"
+#include "baglock.h"
+#include "indexcache.h"
+
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+
+#include <QDebug>
+
+#include <algorithm>
+#include <limits>
+#include <thread>
+
+// Minimum interval between two progress notifications, in milliseconds.
+static const qint64 PROGRESS_INTERVAL = 100;
+
+BagParser::BagParser(const QString &bagPath, const ParseOptions &options, QObject *parent):
+	QThread(parent),
+	mBagPath(bagPath),
+	mOptions(options),
+	mFromCache(false),
+	mCancelled(false),
+	mFailed(false),
+	mLastReport(0)
+{
+	mData.startTime = mData.endTime = 0;
+}
+
+void BagParser::run() {
+	mElapsedTimer.start();
+
+	try {
+		rosbag::Bag bag;
+		{
+			QReadLocker locker(&BagLock::instance());
+			bag.open(mBagPath.toStdString());
+		}
+
+		readMetadata(bag);
+
+		mFromCache = IndexCache(mBagPath, mOptions.useRosTime, mOptions.topicFilter).load(mData, mOptions.windowed);
+
+		// Only extract the selected topics, but keep the time span of the whole bag
+		// so that the timeline does not depend on the selection.
+		std::vector<std::string> filter;
+		bool extract = true;
+
+		if (mFromCache) {
+			// Timelines were read from the cache, so only payloads that have to be resident remain
+			extract = false;
+
+			if (!mOptions.windowed) {
+				for (const auto &handler : mData.messages.handlers()) {
+					if (!handler->resident()) {
+						continue;
+					}
+
+					for (const QVariant &topic : mData.topicsByType.value(handler->type()).toList()) {
+						if (mOptions.topicFilter.isEmpty() || mOptions.topicFilter.contains(topic.toString())) {
+							filter.push_back(topic.toString().toStdString());
+							extract = true;
+						}
+					}
+				}
+			}
+		}
+		else {
+			for (const QString &topic : mOptions.topicFilter) {
+				filter.push_back(topic.toStdString());
+			}
+		}
+
+		if (extract) {
+			std::unique_ptr<rosbag::View> view(filter.empty() ? new rosbag::View(bag) : new rosbag::View(bag, rosbag::TopicQuery(filter)));
+			const uint64_t total = view->size();
+			view.reset();
+
+			if (!extractRanges(filter, total)) {
+				mFailed = true;
+			}
+		}
+		else {
+			reportProgress(0, 0, true);
+		}
+
+		bag.close();
+	}
+	catch (const rosbag::BagException &e) {
+		qDebug() << "An exception has occured while parsing bag " << mBagPath << ": " << e.what();
+		mFailed = true;
+	}
+
+	if (mCancelled || mFailed) {
+		return;
+	}
+
+	if (mData.startTime > mData.endTime) {
+		mData.startTime = mData.endTime = 0;
+	}
+
+	// Cached timelines were stored sorted
+	if (!mFromCache) {
+		sortMessages();
+
+		IndexCache(mBagPath, mOptions.useRosTime, mOptions.topicFilter).save(mData);
+	}
+
+	// Left for last, so that sorting and saving work on plain columns
+	if (mOptions.compress) {
+		compressMessages();
+	}
+}
+
+bool BagParser::extractRanges(const std::vector<std::string> &filter, uint64_t total) {
+	if (total == 0) {
+		reportProgress(0, 0, true);
+		return true;
+	}
+
+	// Split the bag into disjoint, time ordered ranges, each read through its own bag handle.
+	// Views include both ends of their range, hence the ranges ending one nanosecond early.
+	// Ranges are never empty, and the first span % threads ones are a nanosecond longer, which
+	// spreads the span without multiplying it, since stamps can be decades apart.
+	const uint64_t start = mData.startTime;
+	const uint64_t end = std::max(mData.startTime, mData.endTime);
+	const uint64_t span = end - start + 1;
+	const int threads = static_cast<int>(std::min<uint64_t>(threadCount(), span));
+	const uint64_t step = span / threads;
+	const uint64_t remainder = span % threads;
+
+	std::vector<Extraction> extractions(threads);
+	std::atomic<uint64_t> parsed(0);
+	std::atomic<int> running(threads);
+	std::atomic<bool> failed(false);
+	std::vector<std::thread> workers;
+
+	for (int i = 0; i < threads; ++i) {
+		const uint64_t rangeStart = start + step * i + std::min<uint64_t>(i, remainder);
+		const uint64_t rangeEnd = rangeStart + step + (static_cast<uint64_t>(i) < remainder ? 1 : 0) - 1;
+		Extraction *extraction = &extractions[i];
+
+		extraction->data.startTime = std::numeric_limits<uint64_t>::max();
+		extraction->data.endTime = 0;
+
+		workers.emplace_back([&, rangeStart, rangeEnd, extraction]() {
+			try {
+				ros::Time startTime, endTime;
+				startTime.fromNSec(rangeStart);
+				endTime.fromNSec(rangeEnd);
+
+				rosbag::Bag bag;
+				{
+					QReadLocker locker(&BagLock::instance());
+					bag.open(mBagPath.toStdString());
+				}
+				std::unique_ptr<rosbag::View> view(filter.empty() ?
+					new rosbag::View(bag, startTime, endTime) :
+					new rosbag::View(bag, rosbag::TopicQuery(filter), startTime, endTime));
+
+				for (auto it = view->begin(); it != view->end() && !mCancelled; ++it) {
+					extractMessage(*it, *extraction);
+					++parsed;
+				}
+			}
+			catch (const rosbag::BagException &e) {
+				qDebug() << "An exception has occured while parsing bag " << mBagPath << ": " << e.what();
+				failed = true;
+			}
+
+			--running;
+		});
+	}
+
+	while (running > 0) {
+		reportProgress(parsed, total, false);
+		QThread::msleep(PROGRESS_INTERVAL / 2);
+	}
+
+	for (auto &worker : workers) {
+		worker.join();
+	}
+
+	reportProgress(parsed, total, true);
+
+	if (failed || mCancelled) {
+		return !failed;
+	}
+
+	mergeExtractions(extractions);
+
+	return true;
+}
+
+void BagParser::mergeExtractions(std::vector<Extraction> &extractions) {
+	for (const Extraction &extraction : extractions) {
+		mData.startTime = std::min(mData.startTime, extraction.data.startTime);
+		mData.endTime = std::max(mData.endTime, extraction.data.endTime);
+	}
+
+	// Ranges are disjoint and in time order, and each of them is read in time order, so
+	// merging their timelines comes down to concatenating them, one topic per thread.
+	// Every registry holds the same types in the same order.
+	const auto &handlers = mData.messages.handlers();
+	for (size_t type = 0; type < handlers.size(); ++type) {
+		TopicHandler &messages = *handlers[type];
+
+		QVector<const TopicHandler *> parts;
+		for (const Extraction &extraction : extractions) {
+			const TopicHandler *part = extraction.data.messages.handlers()[type].get();
+			parts.append(part);
+
+			for (int handle = 0; handle < part->count(); ++handle) {
+				messages.insert(part->topic(handle));
+			}
+		}
+
+		parallelFor(messages.count(), threadCount(), [&](int handle) {
+			messages.concatenate(handle, parts);
+		});
+
+		for (Extraction &extraction : extractions) {
+			extraction.data.messages.handlers()[type]->clear();
+		}
+	}
+}
+
+void BagParser::sortMessages() {
+	for (const auto &handler : mData.messages.handlers()) {
+		parallelFor(handler->count(), threadCount(), [&](int handle) {
+			handler->sort(handle);
+		});
+	}
+}
+
+void BagParser::compressMessages() {
+	for (const auto &handler : mData.messages.handlers()) {
+		std::vector<qint64> savings(handler->count(), 0);
+		parallelFor(handler->count(), threadCount(), [&](int handle) {
+			if (handler->size(handle) >= COMPRESS_MIN_MESSAGES) {
+				savings[handle] = handler->compress(handle);
+			}
+		});
+
+		for (int handle = 0; handle < handler->count(); ++handle) {
+			if (savings[handle] > 0) {
+				mData.memorySavings.insert(handler->topic(handle), savings[handle]);
+			}
+		}
+	}
+}
+
+int BagParser::threadCount() const {
+	return mOptions.threads > 0 ? mOptions.threads : std::max(QThread::idealThreadCount(), 1);
+}
+
+void BagParser::parallelFor(int count, int threads, const std::function<void(int)> &job) {
+	std::atomic<int> next(0);
+	std::vector<std::thread> workers;
+
+	for (int i = 0; i < std::min(count, threads); ++i) {
+		workers.emplace_back([&]() {
+			for (int index = next++; index < count; index = next++) {
+				job(index);
+			}
+		});
+	}
+
+	for (auto &worker : workers) {
+		worker.join();
+	}
+}
+
+void BagParser::readMetadata(const rosbag::Bag &bag) {
+	// Connection and chunk index records are all loaded when the bag is opened,
+	// so none of the following needs to touch message data.
+	rosbag::View view(bag);
+
+	for (const rosbag::ConnectionInfo *connection : view.getConnections()) {
+		const QString topic(connection->topic.c_str());
+		if (mData.topics.find(topic) != mData.topics.end()) {
+			continue;
+		}
+
+		addTopic(topic, topicType(connection->datatype));
+
+		rosbag::View topicView(bag, rosbag::TopicQuery(connection->topic));
+		mMessageCounts.insert(topic, topicView.size());
+	}
+
+	if (view.size() > 0) {
+		mData.startTime = view.getBeginTime().toNSec();
+		mData.endTime = view.getEndTime().toNSec();
+
+		emit metadataReady(mData.topics, mData.topicsByType, mData.annotationTopics, mMessageCounts, mData.startTime, mData.endTime);
+	}
+	else {
+		// Extracted messages will widen this span
+		mData.startTime = std::numeric_limits<uint64_t>::max();
+		mData.endTime = 0;
+
+		emit metadataReady(mData.topics, mData.topicsByType, mData.annotationTopics, mMessageCounts, 0, 0);
+	}
+}
+
+void BagParser::addTopic(const QString &topic, const QString &type) {
+	if (mData.topics.find(topic) == mData.topics.end()) {
+		mData.topics.insert(topic, QVariant(type));
+
+		if (mData.topicsByType.find(type) == mData.topicsByType.end()) {
+			mData.topicsByType.insert(type, QVariantList({topic}));
+		}
+		else {
+			QVariantList tmp = mData.topicsByType[type].toList();
+			tmp.append(topic);
+			mData.topicsByType.insert(type, tmp);
+		}
+	}
+
+	const QString annotationPrefix("/annotation/");
+	if (topic.startsWith(annotationPrefix)) {
+		QString topicName(topic);
+		topicName.remove(0, annotationPrefix.length());
+		if (mData.annotationTopics.find(topicName) == mData.annotationTopics.end()) {
+			mData.annotationTopics.insert(topicName, type);
+		}
+	}
+}
+
+QString BagParser::topicType(const std::string &dataType) const {
+	const TopicHandler *handler = mData.messages.handlerOf(dataType);
+	return handler ? handler->type() : QString(dataType.c_str());
+}
+
+void BagParser::reportProgress(uint64_t parsed, uint64_t total, bool force) {
+	const qint64 elapsed = mElapsedTimer.elapsed();
+	if (!force && elapsed - mLastReport < PROGRESS_INTERVAL) {
+		return;
+	}
+	mLastReport = elapsed;
+
+	double progress = total > 0 ? static_cast<double>(parsed) / total : 1.0;
+	double messagesPerSecond = elapsed > 0 ? 1e3 * parsed / elapsed : 0.0;
+	double eta = messagesPerSecond > 0 ? (total - parsed) / messagesPerSecond : 0.0;
+
+	emit progressChanged(progress, messagesPerSecond, eta);
+}
+
+void BagParser::extractMessage(const rosbag::MessageInstance &msg, Extraction &extraction) {
+	BagData &data = extraction.data;
+	const uint64_t time = msg.getTime().toNSec();
+
+	// Messages of types without a handler only widen the time span
+	TopicHandler *handler = data.messages.handlerOf(msg.getDataType());
+	if (handler) {
+		handler->extract(msg, time, mOptions.windowed);
+	}
+
+	if (time < data.startTime) {
+		data.startTime = time;
+	}
+
+	if (time > data.endTime) {
+		data.endTime = time;
+	}
+}
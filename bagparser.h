@@ -0,0 +1,118 @@
+#ifndef BAGPARSER_H
+#define BAGPARSER_H
+
+#include <QThread>
+#include <QVariantMap>
+#include <QStringList>
+#include <QElapsedTimer>
+#include <QHash>
+
+#include <rosbag/message_instance.h>
+
+#include "timeline.h"
+#include "topicregistry.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace rosbag {
+	class Bag;
+}
+
+// Everything extracted from a bag. A parser fills its own instance on the
+// worker thread, which the annotator then swaps into place once parsing is done.
+struct BagData {
+	uint64_t startTime;
+	uint64_t endTime;
+
+	QVariantMap topics;
+	QVariantMap topicsByType;
+	QVariantMap annotationTopics;
+
+	// Timelines of every message type
+	TopicRegistry messages;
+
+	// Bytes saved on each topic whose timeline was compressed
+	QVariantMap memorySavings;
+};
+
+struct ParseOptions {
+	bool useRosTime;
+	// Only these topics are extracted when not empty
+	QStringList topicFilter;
+	// Only keep timestamps of image messages, see MessageCache
+	bool windowed;
+	// Number of extraction threads, or 0 to use one per core
+	int threads;
+	// Compress timestamps and string values of long timelines, see TimeColumn
+	bool compress;
+};
+
+class BagParser : public QThread
+{
+	Q_OBJECT
+	Q_DISABLE_COPY(BagParser)
+
+public:
+	BagParser(const QString &bagPath, const ParseOptions &options, QObject *parent = nullptr);
+
+	void cancel() { mCancelled = true; }
+	bool cancelled() const { return mCancelled; }
+	bool failed() const { return mFailed; }
+
+	// Only safe to access once the thread has finished.
+	BagData &data() { return mData; }
+
+	// Maps a ROS message datatype to the type name exposed to QML
+	QString topicType(const std::string &dataType) const;
+
+signals:
+	// Emitted as soon as topics, their types and message counts and the bag's time span
+	// have been read from the bag index, before any message is deserialized.
+	void metadataReady(const QVariantMap &topics, const QVariantMap &topicsByType,
+					   const QVariantMap &annotationTopics, const QVariantMap &messageCounts,
+					   quint64 startTime, quint64 endTime);
+	void progressChanged(double progress, double messagesPerSecond, double eta);
+
+protected:
+	void run() override;
+
+private:
+	// Messages extracted by one thread, from one time range of the bag
+	struct Extraction {
+		BagData data;
+	};
+
+	void readMetadata(const rosbag::Bag &bag);
+	void addTopic(const QString &topic, const QString &type);
+	bool extractRanges(const std::vector<std::string> &filter, uint64_t total);
+	void extractMessage(const rosbag::MessageInstance &msg, Extraction &extraction);
+	void mergeExtractions(std::vector<Extraction> &extractions);
+	void sortMessages();
+	void compressMessages();
+	void reportProgress(uint64_t parsed, uint64_t total, bool force);
+	int threadCount() const;
+
+	// Shorter timelines take little memory either way
+	static const int COMPRESS_MIN_MESSAGES = 1024;
+
+	// Runs job(0) to job(count - 1) on at most the given number of threads
+	static void parallelFor(int count, int threads, const std::function<void(int)> &job);
+
+	QString mBagPath;
+	ParseOptions mOptions;
+	bool mFromCache;
+	std::atomic<bool> mCancelled;
+	bool mFailed;
+
+	QElapsedTimer mElapsedTimer;
+	qint64 mLastReport;
+
+	QVariantMap mMessageCounts;
+	BagData mData;
+};
+
+#endif // BAGPARSER_H
@@ -0,0 +1,65 @@
+#include "bagparser.h"
+#include "indexcache.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QStringList>
+#include <QTextStream>
+
+#include <algorithm>
+
+// Times parsing a bag with 1 up to the given number of extraction threads. The index cache
+// of the bag is removed before each run, so that every run extracts every message.
+//
+// Usage: parse-benchmark <bag> [threads]
+
+int main(int argc, char *argv[]) {
+	QCoreApplication app(argc, argv);
+	const QStringList arguments = app.arguments();
+
+	if (arguments.size() < 2) {
+		QTextStream(stderr) << "Usage: parse-benchmark <bag> [threads]" << endl;
+		return 1;
+	}
+
+	const QString bagPath = arguments[1];
+	const int maxThreads = arguments.size() > 2 ? arguments[2].toInt() : QThread::idealThreadCount();
+
+	ParseOptions options;
+	options.useRosTime = false;
+	options.windowed = false;
+	options.compress = false;
+
+	QTextStream out(stdout);
+	out << qSetFieldWidth(12) << right << "threads" << "ms" << "speedup" << qSetFieldWidth(0) << endl;
+
+	qint64 single = 0;
+	for (int threads = 1; threads <= std::max(maxThreads, 1); ++threads) {
+		QFile::remove(IndexCache(bagPath, options.useRosTime, options.topicFilter).cachePath());
+
+		options.threads = threads;
+		BagParser parser(bagPath, options);
+
+		QElapsedTimer timer;
+		timer.start();
+		parser.start();
+		parser.wait();
+		const qint64 elapsed = timer.elapsed();
+
+		if (parser.failed()) {
+			QTextStream(stderr) << "Could not parse " << bagPath << endl;
+			return 1;
+		}
+
+		if (threads == 1) {
+			single = elapsed;
+		}
+		const double speedup = elapsed > 0 ? static_cast<double>(single) / elapsed : 0.0;
+
+		out << qSetFieldWidth(12) << threads << elapsed << QString::number(speedup, 'f', 2)
+			<< qSetFieldWidth(0) << endl;
+	}
+
+	return 0;
+}
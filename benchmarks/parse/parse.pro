@@ -0,0 +1,31 @@
+TEMPLATE = app
+TARGET = parse-benchmark
+QT = core
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+# Input
+SOURCES += \
+        main.cpp \
+        ../../bagparser.cpp \
+        ../../indexcache.cpp \
+        ../../topicregistry.cpp
+
+HEADERS += \
+        ../../bagparser.h \
+        ../../indexcache.h \
+        ../../topicregistry.h \
+        ../../imageptr.h \
+        ../../baglock.h \
+        ../../timeline.h
+
+#Check for ROS DISTRO
+_ROSPATH = "/opt/ros/$$(ROS_DISTRO)"
+isEmpty(_ROSPATH){message("ROS DISTRO" not detected...)}
+else{
+message("/opt/ros/$$(ROS_DISTRO)")
+INCLUDEPATH += "/opt/ros/$$(ROS_DISTRO)/include"
+LIBS += -L"/opt/ros/$$(ROS_DISTRO)/lib" -lrosbag_storage -lroscpp_serialization
+}
@@ -0,0 +1,138 @@
+#include "timeline.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QTextStream>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+// Compares seeking a timeline by walking it one message at a time, as the annotator did
+// before seekTime, against the galloping seek of plain and compressed timestamp columns.
+//
+// Usage: seek-benchmark [messages] [frequency]
+
+// The seek seekTime replaced: walks from the current message towards time
+static int linearSeek(const QVector<uint64_t> &times, uint64_t time, int current) {
+	if (current >= 0 && times[current] > time) {
+		while (current >= 0 && times[current] > time) {
+			--current;
+		}
+	}
+	else {
+		while (current + 1 < times.size() && times[current + 1] <= time) {
+			++current;
+		}
+	}
+	return current;
+}
+
+struct Result {
+	qint64 nanoseconds;
+	qint64 checksum;
+};
+
+template<class Seek>
+static Result run(const QVector<uint64_t> &targets, Seek seek) {
+	Result result;
+	result.checksum = 0;
+
+	QElapsedTimer timer;
+	timer.start();
+
+	int current = -1;
+	for (uint64_t target : targets) {
+		current = seek(target, current);
+		result.checksum += current;
+	}
+
+	result.nanoseconds = timer.nsecsElapsed();
+	return result;
+}
+
+static void compare(QTextStream &out, const QString &scenario, const QVector<uint64_t> &times,
+					const TimeColumn &compressed, const QVector<uint64_t> &targets) {
+	const Result linear = run(targets, [&](uint64_t time, int current) {
+		return linearSeek(times, time, current);
+	});
+	const Result galloping = run(targets, [&](uint64_t time, int current) {
+		return seekTime(times, time, current);
+	});
+	const Result blocks = run(targets, [&](uint64_t time, int current) {
+		return compressed.seek(time, current);
+	});
+
+	if (linear.checksum != galloping.checksum || linear.checksum != blocks.checksum) {
+		out << scenario << ": seeks disagree" << endl;
+		return;
+	}
+
+	auto perSeek = [&](const Result &result) {
+		return QString::number(static_cast<double>(result.nanoseconds) / targets.size(), 'f', 1);
+	};
+
+	out << qSetFieldWidth(24) << left << scenario << qSetFieldWidth(0)
+		<< qSetFieldWidth(12) << right << targets.size()
+		<< perSeek(linear) << perSeek(galloping) << perSeek(blocks) << qSetFieldWidth(0) << endl;
+}
+
+int main(int argc, char *argv[]) {
+	QCoreApplication app(argc, argv);
+	const QStringList arguments = app.arguments();
+
+	const int count = arguments.size() > 1 ? arguments[1].toInt() : 1000000;
+	const double frequency = arguments.size() > 2 ? arguments[2].toDouble() : 30.0;
+	if (count <= 0 || frequency <= 0.0) {
+		QTextStream(stderr) << "Usage: seek-benchmark [messages] [frequency]" << endl;
+		return 1;
+	}
+
+	// A steady-rate topic with some jitter, as recorded by a camera
+	std::mt19937_64 random(42);
+	std::uniform_int_distribution<int64_t> jitter(-1000000, 1000000);
+	const uint64_t period = static_cast<uint64_t>(1e9 / frequency);
+	const uint64_t start = 1500000000ull * 1000000000ull;
+
+	QVector<uint64_t> times;
+	times.reserve(count);
+	for (int i = 0; i < count; ++i) {
+		times.append(start + i * period + jitter(random));
+	}
+	std::sort(times.begin(), times.end());
+
+	TimeColumn compressed(times);
+	compressed.compress();
+
+	const uint64_t end = times.last();
+
+	QTextStream out(stdout);
+	out << count << " messages at " << frequency << " Hz, nanoseconds per seek" << endl;
+	out << qSetFieldWidth(24) << left << "scenario" << qSetFieldWidth(0)
+		<< qSetFieldWidth(12) << right << "seeks" << "linear" << "galloping" << "compressed"
+		<< qSetFieldWidth(0) << endl;
+
+	// Playback at a few rates, one seek per 60 Hz display frame
+	for (double rate : {1.0, 16.0, -16.0}) {
+		const uint64_t step = static_cast<uint64_t>(std::abs(rate) * 1e9 / 60.0);
+		QVector<uint64_t> targets;
+		for (uint64_t time = start; time <= end; time += step) {
+			targets.append(time);
+		}
+		if (rate < 0) {
+			std::reverse(targets.begin(), targets.end());
+		}
+		compare(out, QString("playback %1x").arg(rate), times, compressed, targets);
+	}
+
+	// Scrubbing, each seek landing anywhere
+	std::uniform_int_distribution<uint64_t> anywhere(start, end);
+	QVector<uint64_t> targets;
+	for (int i = 0; i < 1000; ++i) {
+		targets.append(anywhere(random));
+	}
+	compare(out, "scrub", times, compressed, targets);
+
+	return 0;
+}
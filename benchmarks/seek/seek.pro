@@ -0,0 +1,14 @@
+TEMPLATE = app
+TARGET = seek-benchmark
+QT = core
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+# Input
+SOURCES += \
+        main.cpp
+
+HEADERS += \
+        ../../timeline.h
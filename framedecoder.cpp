@@ -0,0 +1,207 @@
+#include "framedecoder.h"
+#include "rawimage.h"
+
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QBuffer>
+#include <QImageReader>
+
+#include <algorithm>
+#include <limits>
+
+class FrameDecoder::Task : public QRunnable
+{
+public:
+	Task(FrameDecoder *decoder, const Key &key, const ImagePtr &image, const QSize &scaledSize, const Loader &loader):
+		mDecoder(decoder),
+		mKey(key),
+		mImage(image),
+		mScaledSize(scaledSize),
+		mLoader(loader)
+	{
+	}
+
+	void run() override {
+		// The frame was cancelled while queued
+		if (!mDecoder->isPending(mKey)) {
+			return;
+		}
+
+		if (!mImage) {
+			mImage = mLoader(mKey.first, mKey.second);
+			if (!mImage) {
+				mDecoder->finish(mKey, QImage());
+				return;
+			}
+		}
+
+		if (mImage.raw) {
+			mDecoder->finish(mKey, RawImage::toQImage(mImage.raw));
+			return;
+		}
+
+		const sensor_msgs::CompressedImage &image = *mImage.compressed;
+		QByteArray bytes = QByteArray::fromRawData(reinterpret_cast<const char *>(image.data.data()), image.data.size());
+		QBuffer buffer(&bytes);
+		buffer.open(QIODevice::ReadOnly);
+
+		QImageReader reader(&buffer, image.format.c_str());
+		if (!mScaledSize.isEmpty() && reader.supportsOption(QImageIOHandler::ScaledSize)) {
+			const QSize size = reader.size();
+			const QSize scaled = size.scaled(mScaledSize, Qt::KeepAspectRatioByExpanding);
+			if (size.isValid() && scaled.width() < size.width()) {
+				reader.setScaledSize(scaled);
+			}
+		}
+
+		mDecoder->finish(mKey, reader.read());
+	}
+
+private:
+	FrameDecoder *mDecoder;
+	Key mKey;
+	ImagePtr mImage;
+	QSize mScaledSize;
+	Loader mLoader;
+};
+
+FrameDecoder::FrameDecoder(QObject *parent):
+	QObject(parent),
+	mFrames(256 * 1024)
+{
+	// Leave a core to the interface thread
+	mPool.setMaxThreadCount(std::max(QThread::idealThreadCount() - 1, 1));
+}
+
+FrameDecoder::~FrameDecoder()
+{
+	mPool.clear();
+	mPool.waitForDone();
+}
+
+void FrameDecoder::setLoader(const Loader &loader) {
+	QMutexLocker locker(&mMutex);
+	mLoader = loader;
+}
+
+void FrameDecoder::setBudget(qint64 bytes) {
+	QMutexLocker locker(&mMutex);
+	mFrames.setMaxCost(static_cast<int>(std::min<qint64>(bytes / 1024, std::numeric_limits<int>::max())));
+}
+
+qint64 FrameDecoder::budget() const {
+	QMutexLocker locker(&mMutex);
+	return static_cast<qint64>(mFrames.maxCost()) * 1024;
+}
+
+void FrameDecoder::setScaledSize(const QSize &size) {
+	{
+		QMutexLocker locker(&mMutex);
+		if (size == mScaledSize) {
+			return;
+		}
+		mScaledSize = size;
+	}
+
+	clear();
+}
+
+QSize FrameDecoder::scaledSize() const {
+	QMutexLocker locker(&mMutex);
+	return mScaledSize;
+}
+
+bool FrameDecoder::frame(const QString &topic, uint64_t time, QImage &frame) {
+	QMutexLocker locker(&mMutex);
+
+	// Looking the frame up also marks it as the most recently used one
+	QImage *cached = mFrames.object(Key(topic, time));
+	if (!cached) {
+		return false;
+	}
+
+	frame = *cached;
+	return true;
+}
+
+bool FrameDecoder::contains(const QString &topic, uint64_t time) const {
+	QMutexLocker locker(&mMutex);
+	const Key key(topic, time);
+	return mFrames.contains(key) || mPending.contains(key);
+}
+
+void FrameDecoder::request(const QString &topic, uint64_t time, const ImagePtr &image, bool urgent) {
+	request(QVector<Request>{{topic, time, image}}, urgent);
+}
+
+void FrameDecoder::request(const QVector<Request> &requests, bool urgent) {
+	QVector<Task *> tasks;
+	tasks.reserve(requests.size());
+
+	{
+		QMutexLocker locker(&mMutex);
+		for (const Request &request : requests) {
+			const Key key(request.topic, request.time);
+			if ((!request.image && !mLoader) || mFrames.contains(key) || mPending.contains(key)) {
+				continue;
+			}
+			mPending.insert(key);
+			tasks.append(new Task(this, key, request.image, mScaledSize, mLoader));
+		}
+	}
+
+	for (Task *task : tasks) {
+		mPool.start(task, urgent ? 1 : 0);
+	}
+}
+
+void FrameDecoder::cancelPending() {
+	mPool.clear();
+
+	// Frames that were already being decoded still end up in the cache
+	QMutexLocker locker(&mMutex);
+	mPending.clear();
+}
+
+void FrameDecoder::cancel(const QString &topic, uint64_t time) {
+	// The task stays queued, but returns as soon as it runs
+	QMutexLocker locker(&mMutex);
+	mPending.remove(Key(topic, time));
+}
+
+void FrameDecoder::clear() {
+	cancelPending();
+	mPool.waitForDone();
+
+	QMutexLocker locker(&mMutex);
+	mFrames.clear();
+}
+
+bool FrameDecoder::isPending(const Key &key) const {
+	QMutexLocker locker(&mMutex);
+	return mPending.contains(key);
+}
+
+void FrameDecoder::finish(const Key &key, const QImage &frame) {
+	{
+		QMutexLocker locker(&mMutex);
+		mPending.remove(key);
+
+		if (frame.isNull()) {
+			return;
+		}
+
+		// The budget always holds one frame, since a frame QCache refuses would never be
+		// shown and be requested again on every frameReady
+		const int cost = std::max(static_cast<int>(frame.sizeInBytes() / 1024), 1);
+		if (cost > mFrames.maxCost()) {
+			mFrames.setMaxCost(cost);
+		}
+
+		if (!mFrames.insert(key, new QImage(frame), cost)) {
+			return;
+		}
+	}
+
+	emit frameReady(key.first, key.second);
+}
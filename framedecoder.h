@@ -0,0 +1,94 @@
+#ifndef FRAMEDECODER_H
+#define FRAMEDECODER_H
+
+#include <QObject>
+#include <QCache>
+#include <QImage>
+#include <QSize>
+#include <QMutex>
+#include <QSet>
+#include <QVector>
+#include <QPair>
+#include <QThreadPool>
+
+#include "imageptr.h"
+
+#include <functional>
+
+// Decodes compressed images on a pool of threads, so that the interface thread never waits
+// for JPEG or PNG decompression, or for the conversion of raw images that are not zero-copy.
+// Decoded frames are kept in a least recently used cache bounded by a byte budget, and
+// frameReady is emitted whenever a requested frame is ready.
+class FrameDecoder : public QObject
+{
+	Q_OBJECT
+	Q_DISABLE_COPY(FrameDecoder)
+
+public:
+	struct Request {
+		QString topic;
+		uint64_t time;
+		ImagePtr image;
+	};
+
+	// Reads the payload of an image that is not resident, called from the decoding threads
+	typedef std::function<ImagePtr(const QString &topic, uint64_t time)> Loader;
+
+	FrameDecoder(QObject *parent = nullptr);
+	~FrameDecoder();
+
+	// Requests without a payload are only queued when a loader is set, which then reads it
+	// before decoding, e.g. from a MessageCache
+	void setLoader(const Loader &loader);
+
+	void setBudget(qint64 bytes);
+	qint64 budget() const;
+
+	// When not empty, images are decoded at the smallest size covering it, which formats such
+	// as JPEG do without ever producing the full resolution pixels. Clears decoded frames.
+	void setScaledSize(const QSize &size);
+	QSize scaledSize() const;
+
+	// Returns whether the frame is decoded, in which case it is copied into frame
+	bool frame(const QString &topic, uint64_t time, QImage &frame);
+
+	// Returns whether the frame is decoded or queued for decoding
+	bool contains(const QString &topic, uint64_t time) const;
+
+	// Queues the frame for decoding unless it is decoded or queued already. Frames that are
+	// needed right away are urgent, so that they are decoded before prefetched ones.
+	void request(const QString &topic, uint64_t time, const ImagePtr &image, bool urgent);
+
+	// Queues frames of several topics at once, e.g. those shown side by side, so that they are
+	// decoded in parallel and the interface thread takes the lock only once
+	void request(const QVector<Request> &requests, bool urgent);
+
+	// Drops queued frames that have not started decoding yet, e.g. after the playhead jumped
+	void cancelPending();
+
+	// Drops a single queued frame that is no longer needed, e.g. one that playback went past
+	void cancel(const QString &topic, uint64_t time);
+
+	void clear();
+
+signals:
+	// Emitted from a decoding thread, so connections to objects of other threads are queued
+	void frameReady(const QString &topic, quint64 time);
+
+private:
+	typedef QPair<QString, quint64> Key;
+	class Task;
+
+	bool isPending(const Key &key) const;
+	void finish(const Key &key, const QImage &frame);
+
+	QThreadPool mPool;
+	mutable QMutex mMutex;
+	// Costs are in kilobytes, since QCache counts them in ints
+	QCache<Key, QImage> mFrames;
+	QSet<Key> mPending;
+	QSize mScaledSize;
+	Loader mLoader;
+};
+
+#endif // FRAMEDECODER_H
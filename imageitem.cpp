@@ -1,29 +1,63 @@
 #include "imageitem.h"
 
+#include <QQuickWindow>
+#include <QSGSimpleTextureNode>
+
+#include <algorithm>
+
 ImageItem::ImageItem(QQuickItem *parent)
-: QQuickPaintedItem(parent)
+: QQuickItem(parent),
+  mImageChanged(true)
 {
+    setFlag(ItemHasContents, true);
     mImage = QImage(":/images/no_image.png");
 }
 
-void ImageItem::paint(QPainter *painter) {
-    if (mImage.isNull())
-        return;
+QSGNode *ImageItem::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *) {
+    QSGSimpleTextureNode *node = static_cast<QSGSimpleTextureNode *>(oldNode);
+
+    if (mImage.isNull() || width() <= 0 || height() <= 0) {
+        delete node;
+        mImageChanged = true;
+        return nullptr;
+    }
+
+    if (!node) {
+        node = new QSGSimpleTextureNode();
+        node->setOwnsTexture(true);
+        node->setFiltering(QSGTexture::Linear);
+    }
+
+    // Only a new image is uploaded, resizing the item merely changes the geometry
+    if (mImageChanged) {
+        node->setTexture(window()->createTextureFromImage(mImage));
+        mImageChanged = false;
+    }
 
-    QRectF bounds = boundingRect();
-    QImage scaled = mImage.scaledToHeight(bounds.height());
-    QPointF center = bounds.center() - scaled.rect().center();
+    // Scaled to the item's height and centered horizontally, or left aligned and cropped when wider than the item
+    const qreal scale = height() / mImage.height();
+    const qreal scaledWidth = scale * mImage.width();
+    const qreal x = std::max((width() - scaledWidth) / 2, 0.0);
+    const qreal visibleWidth = std::min(scaledWidth, width());
 
-    if(center.x() < 0)
-        center.setX(0);
-    if(center.y() < 0)
-        center.setY(0);
+    node->setRect(QRectF(x, 0, visibleWidth, height()));
+    node->setSourceRect(QRectF(0, 0, visibleWidth / scale, mImage.height()));
 
-   painter->drawImage(center, scaled);
+    return node;
+}
+
+void ImageItem::geometryChanged(const QRectF &newGeometry, const QRectF &oldGeometry) {
+    QQuickItem::geometryChanged(newGeometry, oldGeometry);
+    update();
 }
 
 void ImageItem::setImage(const QImage &image) {
+    // The same decoded frame is handed out again until the next one is ready
+    if (image.cacheKey() == mImage.cacheKey())
+        return;
+
     mImage = image;
+    mImageChanged = true;
     update();
 
     emit imageChanged();
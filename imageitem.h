@@ -1,13 +1,13 @@
 #ifndef IMAGEITEM_H
 #define IMAGEITEM_H
 
-#include <QQuickPaintedItem>
 #include <QQuickItem>
-#include <QPainter>
 #include <QImage>
-#include <QVector>
+#include <QVector2D>
 
-class ImageItem : public QQuickPaintedItem
+// Displays an image scaled to the item's height. The image is uploaded once as a texture
+// whenever it changes, and scaled by the scene graph when rendered.
+class ImageItem : public QQuickItem
 {
 	Q_OBJECT
 	Q_DISABLE_COPY(ImageItem)
@@ -18,7 +18,6 @@ class ImageItem : public QQuickPaintedItem
 public:
     ImageItem(QQuickItem *parent = nullptr);
     Q_INVOKABLE void setImage(const QImage &image);
-    void paint(QPainter *painter);
     const QImage &image() const { return mImage; }
     QVector2D dims() const { return QVector2D(mImage.width(), mImage.height()); }
 
@@ -26,7 +25,12 @@ signals:
     void imageChanged();
     void dimsChanged(const QVector2D dims);
 
+protected:
+    QSGNode *updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *data) override;
+    void geometryChanged(const QRectF &newGeometry, const QRectF &oldGeometry) override;
+
 private:
     QImage mImage;
+    bool mImageChanged;
 };
 #endif // IMAGEITEM_H
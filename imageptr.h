@@ -0,0 +1,31 @@
+#ifndef IMAGEPTR_H
+#define IMAGEPTR_H
+
+#include <QtGlobal>
+
+#include <sensor_msgs/CompressedImage.h>
+#include <sensor_msgs/Image.h>
+
+// Payload of an image message, which is either compressed or raw
+struct ImagePtr {
+	sensor_msgs::CompressedImage::ConstPtr compressed;
+	sensor_msgs::Image::ConstPtr raw;
+
+	ImagePtr() {}
+	ImagePtr(const sensor_msgs::CompressedImage::ConstPtr &image): compressed(image) {}
+	ImagePtr(const sensor_msgs::Image::ConstPtr &image): raw(image) {}
+
+	explicit operator bool() const { return compressed || raw; }
+
+	qint64 byteSize() const {
+		if (raw) {
+			return sizeof(sensor_msgs::Image) + raw->data.size() + raw->encoding.size();
+		}
+		if (compressed) {
+			return sizeof(sensor_msgs::CompressedImage) + compressed->data.size() + compressed->format.size();
+		}
+		return 0;
+	}
+};
+
+#endif // IMAGEPTR_H
@@ -0,0 +1,162 @@
+#include "indexcache.h"
+#include "bagparser.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDir>
+#include <QDateTime>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+#include <QDebug>
+
+#include <cstring>
+
+static const char MAGIC[8] = {'R', 'B', 'A', 'I', 'N', 'D', 'E', 'X'};
+static const quint32 VERSION = 3;
+static const char *SUFFIX = ".annotator-index";
+
+IndexCache::IndexCache(const QString &bagPath, bool useRosTime, const QStringList &topicFilter):
+	mUseRosTime(useRosTime),
+	mTopicFilter(topicFilter)
+{
+	QFileInfo info(bagPath);
+	mBagPath = info.absoluteFilePath();
+	mBagSize = info.size();
+	mBagModified = info.lastModified().toMSecsSinceEpoch();
+
+	mTopicFilter.sort();
+}
+
+QString IndexCache::cachePath() const {
+	return sidecarPath(mBagPath, SUFFIX);
+}
+
+QString IndexCache::sidecarPath(const QString &bagPath, const QString &suffix) {
+	QFileInfo info(bagPath);
+	const QString path = info.absoluteFilePath();
+	if (QFileInfo(info.absolutePath()).isWritable()) {
+		return path + suffix;
+	}
+
+	QString hash = QCryptographicHash::hash(path.toUtf8(), QCryptographicHash::Sha1).toHex();
+	return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/" + hash + suffix;
+}
+
+bool IndexCache::load(BagData &data, bool windowed) const {
+	QFile file(cachePath());
+	if (!file.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+
+	const uchar *mapped = file.map(0, file.size());
+	if (!mapped) {
+		return false;
+	}
+
+	IndexCacheReader reader(mapped, file.size());
+
+	char magic[8];
+	for (char &c : magic) {
+		c = reader.read<char>();
+	}
+
+	if (std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || reader.read<quint32>() != VERSION) {
+		return false;
+	}
+
+	const bool useRosTime = reader.read<quint32>() != 0;
+	const qint64 bagSize = reader.read<qint64>();
+	const qint64 bagModified = reader.read<qint64>();
+	const quint64 startTime = reader.read<quint64>();
+	const quint64 endTime = reader.read<quint64>();
+	const QString bagPath = QString::fromUtf8(reader.readString());
+	const QString topicFilter = QString::fromUtf8(reader.readString());
+
+	if (!reader.ok() || useRosTime != mUseRosTime || bagSize != mBagSize || bagModified != mBagModified ||
+		bagPath != mBagPath || topicFilter != mTopicFilter.join('\n')) {
+		return false;
+	}
+
+	BagData cached;
+	cached.startTime = startTime;
+	cached.endTime = endTime;
+
+	const quint32 topicCount = reader.read<quint32>();
+	reader.read<quint32>();
+
+	for (quint32 i = 0; i < topicCount && reader.ok(); ++i) {
+		const QString topic = QString::fromUtf8(reader.readString());
+		const QString type = QString::fromUtf8(reader.readString());
+		const quint64 count = reader.read<quint64>();
+		const quint64 *times = reader.readArray<quint64>(count);
+
+		if (!reader.ok()) {
+			break;
+		}
+
+		// The columns of a type that is no longer known cannot be skipped
+		TopicHandler *handler = cached.messages.handler(type);
+		if (!handler || !handler->load(reader, topic, IndexCacheReader::column<uint64_t>(times, count))) {
+			reader.fail();
+		}
+	}
+
+	if (!reader.ok()) {
+		qDebug() << "Ignoring truncated index cache" << file.fileName();
+		return false;
+	}
+
+	if (!windowed) {
+		for (const auto &handler : cached.messages.handlers()) {
+			if (handler->resident()) {
+				handler->clear();
+			}
+		}
+	}
+
+	data.startTime = cached.startTime;
+	data.endTime = cached.endTime;
+	data.messages.swap(cached.messages);
+
+	return true;
+}
+
+bool IndexCache::save(const BagData &data) const {
+	IndexCacheWriter writer;
+
+	for (char c : MAGIC) {
+		writer.write<char>(c);
+	}
+	writer.write<quint32>(VERSION);
+	writer.write<quint32>(mUseRosTime ? 1 : 0);
+	writer.write<qint64>(mBagSize);
+	writer.write<qint64>(mBagModified);
+	writer.write<quint64>(data.startTime);
+	writer.write<quint64>(data.endTime);
+	writer.writeString(mBagPath.toUtf8());
+	writer.writeString(mTopicFilter.join('\n').toUtf8());
+
+	quint32 topicCount = 0;
+	for (const auto &handler : data.messages.handlers()) {
+		topicCount += handler->count();
+	}
+	writer.write<quint32>(topicCount);
+	writer.write<quint32>(0);
+
+	for (const auto &handler : data.messages.handlers()) {
+		handler->save(writer);
+	}
+
+	const QString path = cachePath();
+	QDir().mkpath(QFileInfo(path).absolutePath());
+
+	QSaveFile file(path);
+	if (!file.open(QIODevice::WriteOnly)) {
+		qDebug() << "Could not write index cache" << path;
+		return false;
+	}
+
+	file.write(writer.buffer());
+	return file.commit();
+}
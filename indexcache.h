@@ -0,0 +1,271 @@
+#ifndef INDEXCACHE_H
+#define INDEXCACHE_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QVector>
+
+#include "timeline.h"
+#include "imageptr.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+struct BagData;
+
+// Sidecar file holding the timelines extracted from a bag, so that reopening an unchanged
+// bag does not need to deserialize every message again. Entries are keyed by the bag's path,
+// size and modification time along with the parsing options, and the file is laid out as
+// 8-byte aligned arrays so that it can be memory-mapped and read in place.
+//
+// Each message type stores its own columns, see IndexCacheColumns. Image and audio payloads
+// are not stored, only their timestamps and the sizes of audio payloads.
+class IndexCache
+{
+public:
+	IndexCache(const QString &bagPath, bool useRosTime, const QStringList &topicFilter);
+
+	// Fills the timelines of data. Timelines of resident payloads are only filled when windowed,
+	// since they are otherwise extracted along with their payloads, see TopicHandler::resident.
+	bool load(BagData &data, bool windowed) const;
+	bool save(const BagData &data) const;
+
+	// Path of a file kept alongside the bag, next to it when possible and otherwise in the user's cache directory
+	static QString sidecarPath(const QString &bagPath, const QString &suffix);
+	// Path of the cache file of the bag, shared by every set of parsing options
+	QString cachePath() const;
+
+private:
+
+	QString mBagPath;
+	qint64 mBagSize;
+	qint64 mBagModified;
+	bool mUseRosTime;
+	QStringList mTopicFilter;
+};
+
+// Appends values in native byte order, padding every array to a multiple of 8 bytes
+class IndexCacheWriter {
+public:
+	template<class T>
+	void write(const T &value) {
+		mBuffer.append(reinterpret_cast<const char *>(&value), sizeof(T));
+	}
+
+	template<class T>
+	void writeArray(const T *values, quint64 count) {
+		mBuffer.append(reinterpret_cast<const char *>(values), count * sizeof(T));
+		align();
+	}
+
+	void writeString(const QByteArray &str) {
+		write<quint32>(str.size());
+		mBuffer.append(str);
+		align();
+	}
+
+	void align() {
+		while (mBuffer.size() % 8 != 0) {
+			mBuffer.append('\0');
+		}
+	}
+
+	const QByteArray &buffer() const { return mBuffer; }
+
+private:
+	QByteArray mBuffer;
+};
+
+// Reads back what IndexCacheWriter produced, directly from the mapped file
+class IndexCacheReader {
+public:
+	IndexCacheReader(const uchar *data, qint64 size):
+		mData(data),
+		mSize(size),
+		mPos(0),
+		mOk(true)
+	{
+	}
+
+	template<class T>
+	T read() {
+		T value = T();
+		const uchar *p = take(sizeof(T));
+		if (p) {
+			std::memcpy(&value, p, sizeof(T));
+		}
+		return value;
+	}
+
+	template<class T>
+	const T *readArray(quint64 count) {
+		if (count > static_cast<quint64>(mSize)) {
+			mOk = false;
+			return nullptr;
+		}
+
+		const T *values = reinterpret_cast<const T *>(take(count * sizeof(T)));
+		align();
+		return values;
+	}
+
+	QByteArray readString() {
+		const quint32 size = read<quint32>();
+		const uchar *p = take(size);
+		align();
+		return p ? QByteArray(reinterpret_cast<const char *>(p), size) : QByteArray();
+	}
+
+	// Reading past the end, or a message type that is not known, fails the whole file
+	void fail() { mOk = false; }
+	bool ok() const { return mOk; }
+
+	template<class T, class Stored>
+	static QVector<T> column(const Stored *values, quint64 count) {
+		QVector<T> column;
+		column.reserve(count);
+		for (quint64 i = 0; i < count; ++i) {
+			column.append(static_cast<T>(values[i]));
+		}
+		return column;
+	}
+
+private:
+	const uchar *take(quint64 size) {
+		if (!mOk || size > static_cast<quint64>(mSize - mPos)) {
+			mOk = false;
+			return nullptr;
+		}
+
+		const uchar *p = mData + mPos;
+		mPos += size;
+		return p;
+	}
+
+	void align() {
+		mPos = std::min((mPos + 7) & ~static_cast<qint64>(7), mSize);
+	}
+
+	const uchar *mData;
+	qint64 mSize;
+	qint64 mPos;
+	bool mOk;
+};
+
+// Type in which values of T are stored in the cache
+template<class T>
+struct IndexCacheStorage {
+	typedef T Type;
+};
+
+template<>
+struct IndexCacheStorage<bool> {
+	typedef quint8 Type;
+};
+
+template<>
+struct IndexCacheStorage<int> {
+	typedef qint32 Type;
+};
+
+// Columns of a timeline stored after its timestamps, one specialization per timeline type.
+// Load returns false if the file ends before them.
+template<class TimelineType>
+struct IndexCacheColumns;
+
+template<class T>
+struct IndexCacheColumns<Timeline<T>>
+{
+	typedef typename IndexCacheStorage<T>::Type Stored;
+
+	static void save(IndexCacheWriter &writer, const Timeline<T> &messages) {
+		const QVector<T> column = messages.values();
+		std::vector<Stored> values(column.begin(), column.end());
+		writer.writeArray(values.data(), values.size());
+	}
+
+	static bool load(IndexCacheReader &reader, const QVector<uint64_t> &times, Timeline<T> &messages) {
+		const Stored *values = reader.readArray<Stored>(times.size());
+		if (!values) {
+			return false;
+		}
+
+		messages = Timeline<T>(times, IndexCacheReader::column<T>(values, times.size()));
+		return true;
+	}
+};
+
+// Strings are stored as their UTF-8 bytes one after the other, along with their offsets
+template<>
+struct IndexCacheColumns<Timeline<QString>>
+{
+	static void save(IndexCacheWriter &writer, const Timeline<QString> &messages) {
+		std::vector<quint32> offsets(1, 0);
+		QByteArray bytes;
+		for (const QString &value : messages.values()) {
+			bytes.append(value.toUtf8());
+			offsets.push_back(bytes.size());
+		}
+		writer.writeArray(offsets.data(), offsets.size());
+		writer.writeArray(bytes.constData(), bytes.size());
+	}
+
+	static bool load(IndexCacheReader &reader, const QVector<uint64_t> &times, Timeline<QString> &messages) {
+		const int count = times.size();
+		const quint32 *offsets = reader.readArray<quint32>(count + 1);
+		const char *bytes = offsets ? reader.readArray<char>(offsets[count]) : nullptr;
+		if (!bytes) {
+			return false;
+		}
+
+		QVector<QString> values;
+		values.reserve(count);
+		for (int i = 0; i < count; ++i) {
+			values.append(QString::fromUtf8(bytes + offsets[i], offsets[i + 1] - offsets[i]));
+		}
+		messages = Timeline<QString>(times, values);
+		return true;
+	}
+};
+
+template<class T>
+struct IndexCacheColumns<ArrayTimeline<T>>
+{
+	typedef typename IndexCacheStorage<T>::Type Stored;
+
+	static void save(IndexCacheWriter &writer, const ArrayTimeline<T> &messages) {
+		std::vector<quint32> offsets(messages.offsets().begin(), messages.offsets().end());
+		std::vector<Stored> values(messages.values().begin(), messages.values().end());
+		writer.writeArray(offsets.data(), offsets.size());
+		writer.writeArray(values.data(), values.size());
+	}
+
+	static bool load(IndexCacheReader &reader, const QVector<uint64_t> &times, ArrayTimeline<T> &messages) {
+		const int count = times.size();
+		const quint32 *offsets = reader.readArray<quint32>(count + 1);
+		const Stored *values = offsets ? reader.readArray<Stored>(offsets[count]) : nullptr;
+		if (!values) {
+			return false;
+		}
+
+		messages = ArrayTimeline<T>(times, IndexCacheReader::column<int>(offsets, count + 1),
+									IndexCacheReader::column<T>(values, offsets[count]));
+		return true;
+	}
+};
+
+// Only the timestamps of images are stored, their payloads are read from the bag
+template<>
+struct IndexCacheColumns<Timeline<ImagePtr>>
+{
+	static void save(IndexCacheWriter &, const Timeline<ImagePtr> &) {}
+
+	static bool load(IndexCacheReader &, const QVector<uint64_t> &times, Timeline<ImagePtr> &messages) {
+		messages = Timeline<ImagePtr>(times, QVector<ImagePtr>(times.size()));
+		return true;
+	}
+};
+
+#endif // INDEXCACHE_H
@@ -12,6 +12,17 @@ ScrollView {
 	property var title: qsTr("Annotate")
 	property var config
 	property real playbackFreq: 30.0
+	// Latest values of the subscribed topics, updated by valuesChanged
+	property var currentValues: ({})
+	// Ids through which the image and camera topics are read on every frame, see topicId
+	property int imageTopicId: -1
+	property var cameraTopicIds: []
+
+	MessageDialog {
+		id: journalFailedDialog
+		title: qsTr("Annotations not journaled")
+		icon: StandardIcon.Warning
+	}
 
 	Popup {
 		id: annotationPopup
@@ -270,6 +281,9 @@ ScrollView {
 		    TabButton {
 		        text: qsTr("Map")
 		    }
+		    TabButton {
+		        text: qsTr("Cameras")
+		    }
 		}
 
 		StackLayout {
@@ -344,7 +358,7 @@ ScrollView {
 					}
 
 					for (var i = 0; i < Object.keys(config.mapTopics).length; ++i) {
-						var position = config.bagAnnotator.getCurrentValue(Object.keys(config.mapTopics)[i])
+						var position = currentValues[Object.keys(config.mapTopics)[i]]
 						if (position != null) {
 							var ox = position[0] / config.mapWidth * mapCanvas.width
 							var oy = position[1] / config.mapHeight * mapCanvas.height
@@ -374,11 +388,35 @@ ScrollView {
 					}
 				}
 		    }
+
+			MultiImageItem {
+				id: multiImageItem
+				Layout.alignment: Qt.AlignHCenter | Qt.AlignTop
+				Layout.preferredWidth: 640
+				Layout.maximumWidth: 640
+				Layout.minimumWidth: 640
+				Layout.preferredHeight: 480
+				Layout.maximumHeight: 480
+				Layout.minimumHeight: 480
+
+				// Frames are only fetched while the tab is shown
+				onVisibleChanged: updateCameras()
+
+				MouseArea {
+					anchors.fill: parent
+					onWheel: {
+						seek(config.bagAnnotator.currentTime + 0.005 * wheel.angleDelta.y)
+					}
+				}
+			}
 		}
 
 		Text {
 			Layout.alignment: Qt.AlignHCenter | Qt.AlignVCenter
-			text: config != undefined ? "Current time: " + config.bagAnnotator.currentTime.toFixed(2) : ""
+			text: config != undefined ? "Current time: " + config.bagAnnotator.currentTime.toFixed(2) +
+				(config.bagAnnotator.playing && String(config.audioTopic) !== "" ?
+					" (audio drift: " + Math.round(1000 * config.bagAnnotator.drift) + " ms)" : "") +
+				(config.bagAnnotator.playing ? " (dropped frames: " + config.bagAnnotator.droppedFrames + ")" : "") : ""
 		}
 
 		Rectangle {
@@ -402,14 +440,80 @@ ScrollView {
 				color: "darkGray"
 			}
 
+			// Waveform of the audio topic over the whole bag, one bucket per pixel
+			Canvas {
+				id: waveformCanvas
+				anchors.fill: parent
+
+				onPaint: {
+					var ctx = getContext("2d")
+					ctx.clearRect(0, 0, width, height)
+
+					if (config == undefined || String(config.audioTopic) === "" || config.bagAnnotator.length <= 0) {
+						return
+					}
+
+					var envelope = config.bagAnnotator.getAudioEnvelope(config.audioTopic, 0, config.bagAnnotator.length, width)
+					if (envelope.min === undefined) {
+						return
+					}
+
+					var scale = width / config.bagAnnotator.length
+					var bucketWidth = Math.max(envelope.duration * scale, 1)
+					for (var i = 0; i < envelope.min.length; ++i) {
+						var x = (envelope.start + i * envelope.duration) * scale
+
+						ctx.fillStyle = Qt.rgba(0.3, 0.3, 0.6, 0.5)
+						ctx.fillRect(x, height * (1 - envelope.max[i]) / 2, bucketWidth, height * (envelope.max[i] - envelope.min[i]) / 2)
+
+						ctx.fillStyle = Qt.rgba(0.2, 0.2, 0.5, 0.8)
+						ctx.fillRect(x, height * (1 - envelope.rms[i]) / 2, bucketWidth, height * envelope.rms[i])
+					}
+				}
+			}
+
+			// Preview of the image topic under the mouse while dragging along the timeline
+			ImageItem {
+				id: thumbnailItem
+
+				width: 160
+				height: 120
+				y: -height - 4
+				x: Math.max(0, Math.min(parent.width - width, progressMouseArea.mouseX - width / 2))
+				z: 1
+
+				visible: false
+			}
+
 			MouseArea {
+				id: progressMouseArea
+
 				anchors.fill: parent
-				onClicked: {
-					seek(config.bagAnnotator.length * mouse.x / width)
+				onPressed: {
+					previewThumbnail(mouse.x)
+				}
+				onPositionChanged: {
+					previewThumbnail(mouse.x)
+				}
+				onReleased: {
+					thumbnailItem.visible = false
+					seek(config.bagAnnotator.length * Math.max(0, Math.min(mouse.x, width)) / width)
+				}
+				onCanceled: {
+					thumbnailItem.visible = false
 				}
 				onWheel: {
 					seek(config.bagAnnotator.currentTime + 0.005 * wheel.angleDelta.y)
 				}
+
+				function previewThumbnail(x) {
+					var time = config.bagAnnotator.length * Math.max(0, Math.min(x, width)) / width
+					var thumbnail = config.bagAnnotator.getThumbnail(config.imageTopic, time)
+					if (thumbnail !== undefined) {
+						thumbnailItem.setImage(thumbnail)
+					}
+					thumbnailItem.visible = thumbnail !== undefined
+				}
 			}
 		}
 
@@ -446,6 +550,16 @@ ScrollView {
 				onClicked: next(config.imageTopic)
 			}
 
+			ComboBox {
+				id: rateComboBox
+
+				// Rates outside of 0.5x to 2x, and reverse playback, are muted
+				model: ["-4x", "-2x", "-1x", "-0.5x", "0.25x", "0.5x", "1x", "2x", "4x", "8x"]
+				currentIndex: 6
+
+				onActivated: config.bagAnnotator.setRate(parseFloat(model[index]))
+			}
+
 			Button {
 				text: "Add annotation"
 				onClicked: annotationPopup.open()
@@ -483,7 +597,7 @@ ScrollView {
 					Layout.preferredWidth: 0.25 * root.width
 
 					text: valueToString(
-						config.bagAnnotator.getCurrentValue(Object.keys(config.otherTopics)[index]),
+						currentValues[Object.keys(config.otherTopics)[index]],
 						config.otherTopics[Object.keys(config.otherTopics)[index]]
 					)
 				}
@@ -512,27 +626,101 @@ ScrollView {
 	function load(configuration) {
 		config = configuration
 		config.bagAnnotator.setUseSeparateBag(config.useSeparateBag)
+		if (config.decodeAtDisplaySize) {
+			config.bagAnnotator.setDecodeSize(Qt.size(imageItem.width * Screen.devicePixelRatio, imageItem.height * Screen.devicePixelRatio))
+		}
+		else {
+			config.bagAnnotator.setDecodeSize(Qt.size(0, 0))
+		}
+
+		// Only displayed topics are kept up to date, other topics and map topics being updated
+		// only when their current message changes
+		var displayedTopics = [config.imageTopic].concat(config.cameraTopics, Object.keys(config.otherTopics), Object.keys(config.mapTopics))
+		if (String(config.audioTopic) !== "") {
+			displayedTopics.push(config.audioTopic)
+		}
+		config.bagAnnotator.setSubscribedTopics(displayedTopics)
+		currentValues = config.bagAnnotator.getCurrentValues()
+		resolveTopicIds()
 
 		next(config.imageTopic)
 		mapCanvas.loadImage(config.mapImageUrl)
 
 		updateValues()
 
+		config.bagAnnotator.onTopicsChanged.connect(resolveTopicIds)
 		config.bagAnnotator.onCurrentTimeChanged.connect(updateValues)
+		config.bagAnnotator.onValuesChanged.connect(updateChangedValues)
+		config.bagAnnotator.onFrameReady.connect(updateFrame)
+		config.bagAnnotator.onAudioEnvelopeChanged.connect(updateWaveform)
+		config.bagAnnotator.onAnnotationJournalFailed.connect(showJournalFailed)
+		waveformCanvas.requestPaint()
 		config.bagAnnotator.onPlayingChanged.connect(updatePlayPauseButtonState)
 	}
 
+	function showJournalFailed(path) {
+		journalFailedDialog.text = qsTr("The annotation journal %1 cannot be written. Annotations are written to the bag right away, and a crash may lose the latest ones.").arg(path)
+		journalFailedDialog.open()
+	}
+
+	function resolveTopicIds() {
+		imageTopicId = config.bagAnnotator.topicId(config.imageTopic)
+
+		var ids = []
+		for (var i = 0; i < config.cameraTopics.length; ++i) {
+			ids.push(config.bagAnnotator.topicId(config.cameraTopics[i]))
+		}
+		cameraTopicIds = ids
+	}
+
 	function updateValues(time){
-		imageItem.setImage(config.bagAnnotator.getCurrentValue(config.imageTopic))
+		imageItem.setImage(config.bagAnnotator.getCurrentValue(imageTopicId))
+		updateCameras()
+	}
+
+	function updateChangedValues(values) {
+		var otherTopics = Object.keys(config.otherTopics)
+		var mapChanged = false
+
+		for (var topic in values) {
+			currentValues[topic] = values[topic]
+
+			var i = otherTopics.indexOf(topic)
+			if (i >= 0) {
+				otherTopicsRepeater.itemAt(i).children[1].text = valueToString(values[topic], config.otherTopics[topic])
+			}
+
+			if (config.mapTopics[topic] !== undefined) {
+				mapChanged = true
+			}
+		}
+
+		if (mapChanged) {
+			mapCanvas.requestPaint()
+		}
+	}
+
+	function updateFrame(topic, time) {
+		if (topic === config.imageTopic) {
+			imageItem.setImage(config.bagAnnotator.getCurrentValue(imageTopicId))
+		}
+
+		// Frames of a batch arrive one by one, but the cameras are refreshed once for all of them
+		if (config.cameraTopics.indexOf(topic) >= 0) {
+			Qt.callLater(updateCameras)
+		}
+	}
+
+	function updateWaveform(topic) {
+		if (topic === config.audioTopic) {
+			waveformCanvas.requestPaint()
+		}
+	}
 
-		for (var i = 0; i < otherTopicsRepeater.count; ++i) {
-			otherTopicsRepeater.itemAt(i).children[1].text = valueToString(
-				config.bagAnnotator.getCurrentValue(Object.keys(config.otherTopics)[i]),
-				config.otherTopics[Object.keys(config.otherTopics)[i]]
-			)
+	function updateCameras() {
+		if (imageStack.currentIndex === 2 && config.cameraTopics.length > 0) {
+			multiImageItem.setImages(config.bagAnnotator.getAlignedFrames(cameraTopicIds, config.alignNearestFrames))
 		}
-		
-		mapCanvas.requestPaint()
 	}
 
 	function valueToString(value, type) {
@@ -583,12 +771,12 @@ ScrollView {
 	}
 
 	function previous(topic) {
-		var prevTime = config.bagAnnotator.findPreviousTime(topic);
+		var prevTime = config.bagAnnotator.findPreviousTime(config.bagAnnotator.topicId(topic));
 		seek(prevTime)
 	}
 
 	function next(topic) {
-		var nextTime = config.bagAnnotator.findNextTime(topic);
+		var nextTime = config.bagAnnotator.findNextTime(config.bagAnnotator.topicId(topic));
 		seek(nextTime)
 	}
 
@@ -12,11 +12,16 @@ ScrollView {
 	property var title: qsTr("Configure your annotation session")
 	property var bagAnnotator
 	property var useSeparateBag: true
+	property var decodeAtDisplaySize: false
 	property var imageTopic
+	property var cameraTopics: []
+	property var alignNearestFrames: false
 	property var audioTopic
 	property var otherTopics: new Object({})
 	property var mapTopics: new Object({})
 	property var selectableTopics: new Object({})
+	// Checked camera, other and map topic boxes, so that loading a selection needs no image topic
+	property int checkedTopicCount: 0
 	property var mapImageUrl
 	property var mapWidth
 	property var mapHeight
@@ -32,6 +37,7 @@ ScrollView {
 			id: annotator
 			visible: false
 			Component.onCompleted: bagAnnotator = annotator
+			onTopicsChanged: updateSelectableTopics()
 		}
 
 		RowLayout {
@@ -110,6 +116,102 @@ ScrollView {
 				checked: false
 			}
 
+			Text {
+				Layout.alignment: Qt.AlignRight | Qt.AlignVCenter
+				text: "Load images on demand (for bags larger than memory)?"
+			}
+
+			CheckBox {
+				id: windowedLoadingCheckBox
+				checked: false
+			}
+
+			Text {
+				Layout.alignment: Qt.AlignRight | Qt.AlignVCenter
+				text: "Memory budget for on demand loading (in MB):"
+			}
+
+			TextField {
+				id: memoryBudgetInput
+				enabled: windowedLoadingCheckBox.checked
+				text: "512"
+				validator: IntValidator{bottom: 16}
+			}
+
+			Text {
+				Layout.alignment: Qt.AlignRight | Qt.AlignVCenter
+				text: "Threads used to parse the bag (0 for one per core):"
+			}
+
+			TextField {
+				id: parseThreadsInput
+				text: "0"
+				validator: IntValidator{bottom: 0}
+			}
+
+			Text {
+				Layout.alignment: Qt.AlignRight | Qt.AlignVCenter
+				text: "Compress timelines of long topics in memory?"
+			}
+
+			CheckBox {
+				id: compressTimelinesCheckBox
+				checked: false
+			}
+
+			Text {
+				Layout.alignment: Qt.AlignRight | Qt.AlignVCenter
+				text: "Memory budget for decoded images (in MB):"
+			}
+
+			TextField {
+				id: frameCacheBudgetInput
+				text: "256"
+				validator: IntValidator{bottom: 16}
+			}
+
+			Text {
+				Layout.alignment: Qt.AlignRight | Qt.AlignVCenter
+				text: "Images decoded ahead of the current one:"
+			}
+
+			TextField {
+				id: prefetchFramesInput
+				text: "8"
+				validator: IntValidator{bottom: 0}
+			}
+
+			Text {
+				Layout.alignment: Qt.AlignRight | Qt.AlignVCenter
+				text: "Decode images at display size instead of full resolution?"
+			}
+
+			CheckBox {
+				id: decodeAtDisplaySizeCheckBox
+				checked: false
+			}
+
+			Text {
+				Layout.alignment: Qt.AlignRight | Qt.AlignVCenter
+				text: "Seconds between timeline thumbnails (0 to disable):"
+			}
+
+			TextField {
+				id: thumbnailStrideInput
+				text: "1.0"
+				validator: DoubleValidator{bottom: 0}
+			}
+
+			Text {
+				Layout.alignment: Qt.AlignRight | Qt.AlignVCenter
+				text: "Save timeline thumbnails next to the bag?"
+			}
+
+			CheckBox {
+				id: persistThumbnailsCheckBox
+				checked: true
+			}
+
 			Rectangle {
 				Layout.preferredWidth: 0.95 * root.width
 				Layout.preferredHeight: 1
@@ -161,6 +263,37 @@ ScrollView {
 				model: annotator.topicsByType["Image"]
 			}
 
+			Text {
+				Layout.alignment: Qt.AlignRight | Qt.AlignVCenter
+				text: "Image topics shown side by side (optional):"
+			}
+
+			Flow {
+				Layout.preferredWidth: 0.4 * root.width
+
+				Repeater {
+					id: cameraTopicRepeater
+					model: annotator.topicsByType["Image"]
+
+					CheckBox {
+						text: modelData
+						checked: false
+						onCheckedChanged: checkedTopicCount += checked ? 1 : -1
+						Component.onDestruction: if (checked) checkedTopicCount -= 1
+					}
+				}
+			}
+
+			Text {
+				Layout.alignment: Qt.AlignRight | Qt.AlignVCenter
+				text: "Show the nearest frame of each topic instead of the last one before the playhead?"
+			}
+
+			CheckBox {
+				id: alignNearestFramesCheckBox
+				checked: false
+			}
+
 			Text {
 				id: audioTopicText
 				Layout.alignment: Qt.AlignRight | Qt.AlignVCenter
@@ -259,6 +392,39 @@ ScrollView {
 					load()
 				}
 			}
+
+			Button {
+				enabled: annotator.status == RosBagAnnotator.READY &&
+						 (imageTopicComboBox.currentText.length > 0 || audioTopicComboBox.currentText.length > 0 || checkedTopicCount > 0)
+				text: "Load selected topics only"
+				onClicked: {
+					save()
+					annotator.loadTopics(selectedTopics())
+				}
+			}
+		}
+
+		RowLayout {
+			Layout.fillWidth: true
+			Layout.alignment: Qt.AlignHCenter | Qt.AlignVCenter
+			Layout.bottomMargin: 8
+			spacing: 8
+
+			visible: annotator.status == RosBagAnnotator.PARSING
+
+			ProgressBar {
+				Layout.preferredWidth: 0.5 * root.width
+				value: annotator.progress
+			}
+
+			Text {
+				text: (100 * annotator.progress).toFixed(0) + "% (" + annotator.parseRate.toFixed(0) + " msgs/s, " + annotator.parseEta.toFixed(0) + " s left)"
+			}
+
+			Button {
+				text: "Cancel"
+				onClicked: annotator.cancelParse()
+			}
 		}
 
 		RowLayout {
@@ -267,7 +433,7 @@ ScrollView {
 			Layout.alignment: Qt.AlignHCenter | Qt.AlignVCenter
 			spacing: 4
 
-			visible: annotator.status == RosBagAnnotator.READY
+			visible: annotator.status != RosBagAnnotator.EMPTY
 
 			Text {
 				id: nameText
@@ -283,6 +449,13 @@ ScrollView {
 				font.bold: true
 			}
 
+			Text {
+				id: countText
+				Layout.preferredWidth: 0.1 * root.width
+				text: "Messages"
+				font.bold: true
+			}
+
 			Text {
 				Layout.preferredWidth: 0.15 * root.width
 				Layout.alignment: Qt.AlignHCenter | Qt.AlignVCenter
@@ -319,15 +492,24 @@ ScrollView {
 					text: selectableTopics[Object.keys(selectableTopics)[index]]
 				}
 
+				Text {
+					Layout.preferredWidth: 0.1 * root.width
+					text: messageCountText(Object.keys(selectableTopics)[index])
+				}
+
 				CheckBox {
 					Layout.preferredWidth: 0.15 * root.width
 					Layout.alignment: Qt.AlignHCenter | Qt.AlignVCenter
+					onCheckedChanged: checkedTopicCount += checked ? 1 : -1
+					Component.onDestruction: if (checked) checkedTopicCount -= 1
 				}
 
 				CheckBox {
 					Layout.preferredWidth: 0.15 * root.width
 					Layout.alignment: Qt.AlignHCenter | Qt.AlignVCenter
 					enabled: selectableTopics[Object.keys(selectableTopics)[index]] == "DoubleArray"
+					onCheckedChanged: checkedTopicCount += checked ? 1 : -1
+					Component.onDestruction: if (checked) checkedTopicCount -= 1
 				}
 			}
 		}
@@ -339,8 +521,26 @@ ScrollView {
 
 	function load() {
 		annotator.setUseRosTime(useRosTimeCheckBox.checked)
+		annotator.setWindowedLoading(windowedLoadingCheckBox.checked)
+		annotator.setMemoryBudget(parseInt(memoryBudgetInput.text))
+		annotator.setParseThreads(parseInt(parseThreadsInput.text))
+		annotator.setCompressTimelines(compressTimelinesCheckBox.checked)
+		annotator.setFrameCacheBudget(parseInt(frameCacheBudgetInput.text))
+		annotator.setPrefetchFrames(parseInt(prefetchFramesInput.text))
+		annotator.setThumbnailStride(parseFloat(thumbnailStrideInput.text))
+		annotator.setPersistThumbnails(persistThumbnailsCheckBox.checked)
 		annotator.setBagPath(bagFilePath.text)
+	}
 
+	function messageCountText(topic) {
+		var text = String(annotator.messageCounts[topic])
+		if (annotator.memorySavings[topic] !== undefined) {
+			text += " (-" + Math.round(annotator.memorySavings[topic] / 1024) + " KB)"
+		}
+		return text
+	}
+
+	function updateSelectableTopics() {
 		var temp = {}
 		for (var i = 0; i < Object.keys(annotator.topics).length; ++i) {
 			if (annotator.topics[Object.keys(annotator.topics)[i]] != "Audio" && 
@@ -352,24 +552,52 @@ ScrollView {
 		selectableTopics = new Object(temp)
 	}
 
+	function selectedTopics() {
+		var topics = []
+		if (String(imageTopic) !== "") {
+			topics.push(imageTopic)
+		}
+		if (String(audioTopic) !== "") {
+			topics.push(audioTopic)
+		}
+
+		var keys = Object.keys(otherTopics).concat(Object.keys(mapTopics)).concat(cameraTopics)
+		for (var i = 0; i < keys.length; ++i) {
+			if (topics.indexOf(keys[i]) < 0) {
+				topics.push(keys[i])
+			}
+		}
+
+		return topics
+	}
+
 	function save() {
 		useSeparateBag = useSeparateBagCheckBox.checked
+		decodeAtDisplaySize = decodeAtDisplaySizeCheckBox.checked
 		imageTopic = imageTopicComboBox.currentText
 		audioTopic = audioTopicComboBox.currentText
+		alignNearestFrames = alignNearestFramesCheckBox.checked
+
+		cameraTopics = []
+		for (var i = 0; i < cameraTopicRepeater.count; ++i) {
+			if (cameraTopicRepeater.itemAt(i).checked) {
+				cameraTopics.push(cameraTopicRepeater.itemAt(i).text)
+			}
+		}
 		mapImageUrl = mapFileDialog.fileUrl
 		mapWidth = parseFloat(mapWidthInput.text)
 		mapHeight = parseFloat(mapHeightInput.text)
 
 		otherTopics = {}
 		for (var i = 0; i < topicRepeater.count; ++i) {
-			if (topicRepeater.itemAt(i).children[2].checked) {
+			if (topicRepeater.itemAt(i).children[3].checked) {
 				otherTopics[Object.keys(selectableTopics)[i]] = annotator.topics[Object.keys(selectableTopics)[i]]
 			}
 		}
 
 		mapTopics = {}
 		for (var i = 0; i < topicRepeater.count; ++i) {
-			if (topicRepeater.itemAt(i).children[3].checked) {
+			if (topicRepeater.itemAt(i).children[4].checked) {
 				mapTopics[Object.keys(selectableTopics)[i]] = annotator.topics[Object.keys(selectableTopics)[i]]
 			}
 		}
@@ -0,0 +1,189 @@
+#include "messagecache.h"
+#include "baglock.h"
+
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+
+#include <QMutexLocker>
+#include <QVector>
+#include <QDebug>
+
+// Span loaded around a requested image, in nanoseconds. Playback mostly moves forward,
+// so more is read ahead of the playhead than behind it.
+static const uint64_t WINDOW_BEFORE = 500000000;
+static const uint64_t WINDOW_AFTER = 2000000000;
+
+MessageCache::MessageCache():
+	mBudget(512 * 1024 * 1024),
+	mUsage(0)
+{
+}
+
+MessageCache::~MessageCache()
+{
+}
+
+void MessageCache::setBagPath(const QString &path) {
+	// Waits for windows being read from the previous bag
+	QMutexLocker bagLocker(&mBagMutex);
+	clear();
+	mBag.reset();
+	mBagPath = path;
+}
+
+void MessageCache::setBudget(qint64 bytes) {
+	QMutexLocker locker(&mMutex);
+	mBudget = bytes;
+	evict();
+}
+
+qint64 MessageCache::budget() const {
+	QMutexLocker locker(&mMutex);
+	return mBudget;
+}
+
+qint64 MessageCache::usage() const {
+	QMutexLocker locker(&mMutex);
+	return mUsage;
+}
+
+void MessageCache::clear() {
+	QMutexLocker locker(&mMutex);
+	mImages.clear();
+	mUses.clear();
+	mUsage = 0;
+}
+
+ImagePtr MessageCache::image(const QString &topic, uint64_t time) {
+	ImagePtr image = cached(topic, time);
+	if (image) {
+		return image;
+	}
+
+	QMutexLocker bagLocker(&mBagMutex);
+
+	// Another thread may have read the window while this one was waiting
+	image = cached(topic, time);
+	if (image) {
+		return image;
+	}
+
+	return loadImages(topic, time);
+}
+
+ImagePtr MessageCache::cached(const QString &topic, uint64_t time) {
+	QMutexLocker locker(&mMutex);
+	return find(topic, time);
+}
+
+ImagePtr MessageCache::find(const QString &topic, uint64_t time) {
+	auto topicIt = mImages.find(topic);
+	if (topicIt == mImages.end()) {
+		return ImagePtr();
+	}
+
+	auto it = topicIt->find(time);
+	if (it == topicIt->end()) {
+		return ImagePtr();
+	}
+
+	mUses.splice(mUses.end(), mUses, it->use);
+	return it->image;
+}
+
+bool MessageCache::open() {
+	if (mBag) {
+		return true;
+	}
+
+	if (mBagPath.isEmpty()) {
+		return false;
+	}
+
+	try {
+		QReadLocker locker(&BagLock::instance());
+		mBag.reset(new rosbag::Bag(mBagPath.toStdString()));
+	}
+	catch (const rosbag::BagException &e) {
+		qDebug() << "An exception has occured while opening bag " << mBagPath << ": " << e.what();
+		mBag.reset();
+		return false;
+	}
+
+	return true;
+}
+
+ImagePtr MessageCache::loadImages(const QString &topic, uint64_t time) {
+	if (!open()) {
+		return ImagePtr();
+	}
+
+	const uint64_t start = time > WINDOW_BEFORE ? time - WINDOW_BEFORE : 0;
+	const uint64_t end = time + WINDOW_AFTER;
+
+	// The bag is read without holding mMutex, so that resident payloads can be looked up meanwhile
+	QVector<QPair<uint64_t, ImagePtr>> loaded;
+
+	try {
+		ros::Time startTime, endTime;
+		startTime.fromNSec(start);
+		endTime.fromNSec(end);
+
+		rosbag::View view(*mBag, rosbag::TopicQuery(topic.toStdString()), startTime, endTime);
+		for (auto it = view.begin(); it != view.end(); ++it) {
+			ImagePtr image;
+			if (it->getDataType() == "sensor_msgs/Image") {
+				sensor_msgs::Image::ConstPtr m = it->instantiate<sensor_msgs::Image>();
+				image = m;
+			}
+			else {
+				sensor_msgs::CompressedImage::ConstPtr m = it->instantiate<sensor_msgs::CompressedImage>();
+				image = m;
+			}
+
+			if (image) {
+				loaded.append(qMakePair(it->getTime().toNSec(), image));
+			}
+		}
+	}
+	catch (const rosbag::BagException &e) {
+		qDebug() << "An exception has occured while reading images from bag " << mBagPath << ": " << e.what();
+	}
+
+	QMutexLocker locker(&mMutex);
+	QMap<uint64_t, Entry> &images = mImages[topic];
+
+	for (const auto &message : loaded) {
+		if (images.contains(message.first)) {
+			continue;
+		}
+
+		Entry entry;
+		entry.image = message.second;
+		entry.size = entry.image.byteSize();
+		entry.use = mUses.insert(mUses.end(), Key(topic, message.first));
+
+		images.insert(message.first, entry);
+		mUsage += entry.size;
+	}
+
+	// Marking the requested image as the most recently used one keeps it from being evicted
+	ImagePtr image = find(topic, time);
+	evict();
+	return image;
+}
+
+void MessageCache::evict() {
+	// The most recently used entry is kept even over budget, so that a window larger than the
+	// budget still yields the image it was read for
+	while (mUsage > mBudget && mUses.size() > 1) {
+		const Key &key = mUses.front();
+
+		auto topicIt = mImages.find(key.first);
+		auto it = topicIt->find(key.second);
+		mUsage -= it->size;
+		topicIt->erase(it);
+
+		mUses.pop_front();
+	}
+}
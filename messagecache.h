@@ -0,0 +1,76 @@
+#ifndef MESSAGECACHE_H
+#define MESSAGECACHE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QMap>
+#include <QMutex>
+#include <QPair>
+
+#include "imageptr.h"
+
+#include <list>
+#include <memory>
+
+namespace rosbag {
+	class Bag;
+}
+
+// Instantiates message payloads on demand when a bag was parsed with windowed loading,
+// in which case only the timestamps of image messages are kept in memory.
+// Payloads are read through a time-bounded view around the requested time, and the
+// least recently used ones are evicted whenever the memory budget is exceeded.
+//
+// Reading a window takes a while, so it is meant to be done on the decoding threads, see
+// FrameDecoder::setLoader, while the interface thread only looks up resident payloads.
+class MessageCache
+{
+public:
+	MessageCache();
+	~MessageCache();
+
+	void setBagPath(const QString &path);
+	void setBudget(qint64 bytes);
+	qint64 budget() const;
+	qint64 usage() const;
+
+	void clear();
+
+	// Returns the image published on the topic at exactly the given time, reading the window
+	// around it from the bag if it is not resident
+	ImagePtr image(const QString &topic, uint64_t time);
+
+	// Returns the image if it is resident, without ever reading the bag
+	ImagePtr cached(const QString &topic, uint64_t time);
+
+private:
+	typedef QPair<QString, uint64_t> Key;
+
+	struct Entry {
+		ImagePtr image;
+		qint64 size;
+		// Position in mUses
+		std::list<Key>::iterator use;
+	};
+
+	bool open();
+	// Reads the window around time and returns the image at time, with mBagMutex held
+	ImagePtr loadImages(const QString &topic, uint64_t time);
+	ImagePtr find(const QString &topic, uint64_t time);
+	void evict();
+
+	QString mBagPath;
+	std::unique_ptr<rosbag::Bag> mBag;
+	// Held while reading the bag, so that windows are read one at a time
+	QMutex mBagMutex;
+
+	mutable QMutex mMutex;
+	qint64 mBudget;
+	qint64 mUsage;
+
+	QMap<QString, QMap<uint64_t, Entry>> mImages;
+	// Keys of the entries from the least to the most recently used
+	std::list<Key> mUses;
+};
+
+#endif // MESSAGECACHE_H
@@ -0,0 +1,113 @@
+#include "multiimageitem.h"
+
+#include <QQuickWindow>
+#include <QSGSimpleTextureNode>
+
+#include <cmath>
+
+MultiImageItem::MultiImageItem(QQuickItem *parent)
+: QQuickItem(parent),
+  mColumns(0)
+{
+    setFlag(ItemHasContents, true);
+    mPlaceholder = QImage(":/images/no_image.png");
+}
+
+QSGNode *MultiImageItem::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *) {
+    if (mImages.isEmpty() || width() <= 0 || height() <= 0) {
+        delete oldNode;
+        mImagesChanged.fill(true);
+        return nullptr;
+    }
+
+    QSGNode *root = oldNode ? oldNode : new QSGNode();
+
+    // One texture node per image, in the same order
+    while (root->childCount() > mImages.size()) {
+        QSGNode *child = root->lastChild();
+        root->removeChildNode(child);
+        delete child;
+    }
+    while (root->childCount() < mImages.size()) {
+        QSGSimpleTextureNode *child = new QSGSimpleTextureNode();
+        child->setOwnsTexture(true);
+        child->setFiltering(QSGTexture::Linear);
+        root->appendChildNode(child);
+        mImagesChanged[root->childCount() - 1] = true;
+    }
+
+    const int count = mImages.size();
+    const int columns = mColumns > 0 ? mColumns : static_cast<int>(std::ceil(std::sqrt(count)));
+    const int rows = (count + columns - 1) / columns;
+    const QSizeF cell(width() / columns, height() / rows);
+
+    QSGNode *child = root->firstChild();
+    for (int i = 0; i < count; ++i, child = child->nextSibling()) {
+        QSGSimpleTextureNode *node = static_cast<QSGSimpleTextureNode *>(child);
+        const QImage &image = mImages[i];
+
+        if (mImagesChanged[i]) {
+            node->setTexture(window()->createTextureFromImage(image));
+            mImagesChanged[i] = false;
+        }
+
+        // Fitted to the cell and centered in it
+        const QSizeF size = QSizeF(image.size()).scaled(cell, Qt::KeepAspectRatio);
+        const QPointF origin((i % columns) * cell.width(), (i / columns) * cell.height());
+        node->setRect(QRectF(origin + QPointF((cell.width() - size.width()) / 2, (cell.height() - size.height()) / 2), size));
+    }
+
+    return root;
+}
+
+void MultiImageItem::geometryChanged(const QRectF &newGeometry, const QRectF &oldGeometry) {
+    QQuickItem::geometryChanged(newGeometry, oldGeometry);
+    update();
+}
+
+void MultiImageItem::setImages(const QVariantList &images) {
+    if (images.size() != mImages.size()) {
+        mImages.resize(images.size());
+        mImagesChanged.fill(true, images.size());
+    }
+
+    bool changed = false;
+    for (int i = 0; i < images.size(); ++i) {
+        QImage image = images[i].value<QImage>();
+        if (image.isNull()) {
+            image = mPlaceholder;
+        }
+
+        // Cameras whose frame is still the same one keep their texture
+        if (image.cacheKey() != mImages[i].cacheKey() || mImagesChanged[i]) {
+            mImages[i] = image;
+            mImagesChanged[i] = true;
+            changed = true;
+        }
+    }
+
+    if (!changed) {
+        return;
+    }
+
+    update();
+    emit imagesChanged();
+}
+
+QVariantList MultiImageItem::images() const {
+    QVariantList images;
+    for (const QImage &image : mImages) {
+        images.append(image);
+    }
+    return images;
+}
+
+void MultiImageItem::setColumns(int columns) {
+    if (columns == mColumns) {
+        return;
+    }
+
+    mColumns = columns;
+    update();
+    emit columnsChanged(columns);
+}
@@ -0,0 +1,43 @@
+#ifndef MULTIIMAGEITEM_H
+#define MULTIIMAGEITEM_H
+
+#include <QQuickItem>
+#include <QImage>
+#include <QVariantList>
+#include <QVector>
+
+// Displays several images side by side in a grid, each one fitted to its cell. All cells are
+// drawn by a single item, so refreshing every camera costs one scene graph update, and only
+// images that changed since the last frame are uploaded again.
+class MultiImageItem : public QQuickItem
+{
+	Q_OBJECT
+	Q_DISABLE_COPY(MultiImageItem)
+
+    Q_PROPERTY(QVariantList images READ images WRITE setImages NOTIFY imagesChanged)
+    Q_PROPERTY(int columns READ columns WRITE setColumns NOTIFY columnsChanged)
+
+public:
+    MultiImageItem(QQuickItem *parent = nullptr);
+    Q_INVOKABLE void setImages(const QVariantList &images);
+    QVariantList images() const;
+
+    // Number of columns of the grid, or 0 to make it as square as possible
+    void setColumns(int columns);
+    int columns() const { return mColumns; }
+
+signals:
+    void imagesChanged();
+    void columnsChanged(int columns);
+
+protected:
+    QSGNode *updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *data) override;
+    void geometryChanged(const QRectF &newGeometry, const QRectF &oldGeometry) override;
+
+private:
+    QVector<QImage> mImages;
+    QVector<bool> mImagesChanged;
+    int mColumns;
+    QImage mPlaceholder;
+};
+#endif // MULTIIMAGEITEM_H
@@ -0,0 +1,192 @@
+#include "rawimage.h"
+
+#include <sensor_msgs/image_encodings.h>
+
+#include <algorithm>
+
+namespace enc = sensor_msgs::image_encodings;
+
+static void releaseMessage(void *message) {
+	delete static_cast<sensor_msgs::Image::ConstPtr *>(message);
+}
+
+static inline bool isNativeEndian(const sensor_msgs::Image &image) {
+	return (image.is_bigendian != 0) == (Q_BYTE_ORDER == Q_BIG_ENDIAN);
+}
+
+bool RawImage::isZeroCopy(const sensor_msgs::Image &image) {
+	const std::string &encoding = image.encoding;
+
+	if (encoding == enc::RGB8 || encoding == enc::RGBA8 || encoding == enc::MONO8) {
+		return true;
+	}
+
+	if (encoding == enc::BGRA8) {
+		return Q_BYTE_ORDER == Q_LITTLE_ENDIAN;
+	}
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+	if (encoding == enc::BGR8) {
+		return true;
+	}
+#endif
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+	if (encoding == enc::MONO16) {
+		return isNativeEndian(image);
+	}
+#endif
+
+	return false;
+}
+
+QImage RawImage::toQImage(const sensor_msgs::Image::ConstPtr &image) {
+	if (!image) {
+		return QImage();
+	}
+
+	const std::string &encoding = image->encoding;
+
+	if (encoding == enc::RGB8) {
+		return wrap(image, QImage::Format_RGB888, 3);
+	}
+	else if (encoding == enc::BGR8) {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+		return wrap(image, QImage::Format_BGR888, 3);
+#else
+		// There is no BGR layout before Qt 5.14, so the channels have to be swapped into a copy
+		return wrap(image, QImage::Format_RGB888, 3).rgbSwapped();
+#endif
+	}
+	else if (encoding == enc::RGBA8) {
+		return wrap(image, QImage::Format_RGBA8888, 4);
+	}
+	else if (encoding == enc::BGRA8) {
+		// ARGB32 is stored as B, G, R, A on little endian machines
+		if (Q_BYTE_ORDER == Q_LITTLE_ENDIAN) {
+			return wrap(image, QImage::Format_ARGB32, 4);
+		}
+		return wrap(image, QImage::Format_RGBA8888, 4).rgbSwapped();
+	}
+	else if (encoding == enc::MONO8) {
+		return wrap(image, QImage::Format_Grayscale8, 1);
+	}
+	else if (encoding == enc::MONO16) {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+		if (isNativeEndian(*image)) {
+			return wrap(image, QImage::Format_Grayscale16, 2);
+		}
+#endif
+		return mono16ToMono8(*image);
+	}
+	else if (encoding == enc::BAYER_RGGB8) {
+		return demosaic(*image, "rggb");
+	}
+	else if (encoding == enc::BAYER_BGGR8) {
+		return demosaic(*image, "bggr");
+	}
+	else if (encoding == enc::BAYER_GBRG8) {
+		return demosaic(*image, "gbrg");
+	}
+	else if (encoding == enc::BAYER_GRBG8) {
+		return demosaic(*image, "grbg");
+	}
+
+	return QImage();
+}
+
+QImage RawImage::wrap(const sensor_msgs::Image::ConstPtr &image, QImage::Format format, int bytesPerPixel) {
+	if (image->step < image->width * bytesPerPixel || image->data.size() < static_cast<size_t>(image->step) * image->height) {
+		return QImage();
+	}
+
+	return QImage(image->data.data(), image->width, image->height, image->step, format,
+				  releaseMessage, new sensor_msgs::Image::ConstPtr(image));
+}
+
+QImage RawImage::mono16ToMono8(const sensor_msgs::Image &image) {
+	if (image.step < image.width * 2 || image.data.size() < static_cast<size_t>(image.step) * image.height) {
+		return QImage();
+	}
+
+	// Keeps the most significant byte of each pixel
+	const int high = image.is_bigendian ? 0 : 1;
+
+	QImage converted(image.width, image.height, QImage::Format_Grayscale8);
+	for (uint32_t y = 0; y < image.height; ++y) {
+		const uint8_t *in = image.data.data() + y * image.step;
+		uchar *out = converted.scanLine(y);
+		for (uint32_t x = 0; x < image.width; ++x) {
+			out[x] = in[2 * x + high];
+		}
+	}
+
+	return converted;
+}
+
+// Every 2x2 cell of the pattern holds one red, two green and one blue sample, which give
+// the color of all four pixels of the cell. This halves the color resolution, but is a
+// single pass over the image, which is what playback needs.
+QImage RawImage::demosaic(const sensor_msgs::Image &image, const std::string &pattern) {
+	const int width = image.width;
+	const int height = image.height;
+
+	if (width < 2 || height < 2 || image.step < image.width ||
+		image.data.size() < static_cast<size_t>(image.step) * image.height) {
+		return QImage();
+	}
+
+	// Offsets of the samples of each color within a cell, in the order of the pattern
+	int red = 0, blue = 0, green[2], greens = 0;
+	for (int i = 0; i < 4; ++i) {
+		if (pattern[i] == 'r') {
+			red = i;
+		}
+		else if (pattern[i] == 'b') {
+			blue = i;
+		}
+		else {
+			green[greens++] = i;
+		}
+	}
+
+	QImage converted(width, height, QImage::Format_RGB888);
+
+	for (int y = 0; y + 1 < height; y += 2) {
+		const uint8_t *rows[2] = {image.data.data() + y * image.step, image.data.data() + (y + 1) * image.step};
+		uchar *out[2] = {converted.scanLine(y), converted.scanLine(y + 1)};
+
+		for (int x = 0; x + 1 < width; x += 2) {
+			auto sample = [&](int i) {
+				return rows[i / 2][x + i % 2];
+			};
+
+			const uchar r = sample(red);
+			const uchar g = (sample(green[0]) + sample(green[1]) + 1) / 2;
+			const uchar b = sample(blue);
+
+			for (int row = 0; row < 2; ++row) {
+				for (int column = 0; column < 2; ++column) {
+					uchar *pixel = out[row] + 3 * (x + column);
+					pixel[0] = r;
+					pixel[1] = g;
+					pixel[2] = b;
+				}
+			}
+		}
+
+		// An odd last column repeats the one before it
+		if (width % 2 != 0) {
+			for (int row = 0; row < 2; ++row) {
+				std::copy(out[row] + 3 * (width - 2), out[row] + 3 * (width - 1), out[row] + 3 * (width - 1));
+			}
+		}
+	}
+
+	// And so does an odd last row
+	if (height % 2 != 0) {
+		std::copy(converted.constScanLine(height - 2), converted.constScanLine(height - 2) + 3 * width, converted.scanLine(height - 1));
+	}
+
+	return converted;
+}
@@ -0,0 +1,27 @@
+#ifndef RAWIMAGE_H
+#define RAWIMAGE_H
+
+#include <QImage>
+
+#include <sensor_msgs/Image.h>
+
+// Turns raw sensor_msgs/Image messages into QImages. Encodings that have a matching QImage
+// layout are wrapped around the message buffer without copying, the image keeping the
+// message alive for as long as it exists. Other encodings, such as Bayer patterns, are
+// converted into a new RGB image.
+class RawImage
+{
+public:
+	// Returns whether toQImage wraps the message without copying or converting any pixel
+	static bool isZeroCopy(const sensor_msgs::Image &image);
+
+	// Returns a null image for unsupported encodings or inconsistent dimensions
+	static QImage toQImage(const sensor_msgs::Image::ConstPtr &image);
+
+private:
+	static QImage wrap(const sensor_msgs::Image::ConstPtr &image, QImage::Format format, int bytesPerPixel);
+	static QImage mono16ToMono8(const sensor_msgs::Image &image);
+	static QImage demosaic(const sensor_msgs::Image &image, const std::string &pattern);
+};
+
+#endif // RAWIMAGE_H
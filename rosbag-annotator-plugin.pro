@@ -10,12 +10,43 @@ uri = ch.epfl.chili.ros.annotation
 SOURCES += \
         rosbagannotatorplugin.cpp \
         rosbagannotator.cpp \
-        imageitem.cpp
+        bagparser.cpp \
+        messagecache.cpp \
+        indexcache.cpp \
+        framedecoder.cpp \
+        audiostream.cpp \
+        audioenvelope.cpp \
+        audioenvelopebuilder.cpp \
+        rawimage.cpp \
+        thumbnailindex.cpp \
+        thumbnailbuilder.cpp \
+        topicregistry.cpp \
+        annotationwriter.cpp \
+        imageitem.cpp \
+        multiimageitem.cpp
 
 HEADERS += \
         rosbagannotatorplugin.h \
         rosbagannotator.h \
-        imageitem.h
+        bagparser.h \
+        messagecache.h \
+        indexcache.h \
+        timeline.h \
+        framedecoder.h \
+        audiostream.h \
+        audioenvelope.h \
+        audioenvelopebuilder.h \
+        rawimage.h \
+        thumbnailindex.h \
+        thumbnailbuilder.h \
+        seriespyramid.h \
+        topicregistry.h \
+        imageptr.h \
+        baglock.h \
+        annotations.h \
+        annotationwriter.h \
+        imageitem.h \
+        multiimageitem.h
 
 #Check for ROS DISTRO
 _ROSPATH = "/opt/ros/$$(ROS_DISTRO)"
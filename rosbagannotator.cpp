@@ -1,35 +1,118 @@
 #include "rosbagannotator.h"
+#include "rawimage.h"
 
 #include <rosbag/bag.h>
-#include <rosbag/view.h>
-
-#include <std_msgs/Bool.h>
-#include <std_msgs/Int32.h>
-#include <std_msgs/Float32.h>
-#include <std_msgs/Float64.h>
-#include <std_msgs/String.h>
-#include <std_msgs/Int32MultiArray.h>
-#include <std_msgs/Float32MultiArray.h>
-#include <std_msgs/Float64MultiArray.h>
-#include <audio_common_msgs/AudioData.h>
-
-//#include <chili_msgs/Bool.h>
-//#include <chili_msgs/Double.h>
-//#include <chili_msgs/Int.h>
-//#include <chili_msgs/String.h>
-//#include <chili_msgs/DoubleArray.h>
-//#include <chili_msgs/IntArray.h>
+
+#include <QJSValue>
+#include <QQuickWindow>
 
 #include <algorithm>
-#include <limits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+// Seeking further than this, in nanoseconds, drops frames queued for prefetching
+static const uint64_t PREFETCH_JUMP = 1000000000;
+
+// Drift between the playback clock and the audio clock beyond which the playback clock jumps
+// to the audio one, in nanoseconds. Smaller drifts are corrected by a fraction on every frame.
+static const qint64 DRIFT_RESYNC = 200000000;
+static const qint64 DRIFT_SLEW = 8;
+
+// Rates at which audio is played along, beyond them playback is muted
+static const double MIN_AUDIO_RATE = 0.5;
+static const double MAX_AUDIO_RATE = 2.0;
+
+// Initial estimate of the time between two playback updates, in nanoseconds
+static const qint64 FRAME_INTERVAL = 16666667;
+
+// Values annotateRange writes at most at once, counting array elements
+static const qint64 MAX_RANGE_VALUES = 10000000;
+
+// Values from QML are either JS values or, for packed arrays, the ArrayBuffer of a typed array
+static QVariant fromQml(const QVariant &value) {
+	if (value.userType() == qMetaTypeId<QJSValue>()) {
+		return value.value<QJSValue>().toVariant();
+	}
+	return value;
+}
+
+template<class T>
+static QVector<T> unpack(const QVariant &value) {
+	const QVariant variant = fromQml(value);
+
+	QVector<T> values;
+	if (variant.type() == QVariant::ByteArray) {
+		const QByteArray bytes = variant.toByteArray();
+		values.resize(bytes.size() / sizeof(T));
+		std::memcpy(values.data(), bytes.constData(), values.size() * sizeof(T));
+	}
+	else {
+		const QVariantList list = variant.toList();
+		values.reserve(list.size());
+		for (const QVariant &element : list) {
+			values.append(element.value<T>());
+		}
+	}
+	return values;
+}
+
+// Appends a value as annotate is given it to the column of its type
+static void appendValue(Annotations &annotations, const QVariant &value) {
+	switch (annotations.type) {
+	case Annotations::BOOL:
+		annotations.ints.append(fromQml(value).toBool() ? 1 : 0);
+		break;
+	case Annotations::INT:
+		annotations.ints.append(fromQml(value).toInt());
+		break;
+	case Annotations::DOUBLE:
+		annotations.doubles.append(fromQml(value).toDouble());
+		break;
+	case Annotations::STRING:
+		annotations.strings.append(fromQml(value).toString());
+		break;
+	case Annotations::INT_ARRAY: {
+		const QVector<qint32> elements = unpack<qint32>(value);
+		annotations.ints += elements;
+		annotations.length = elements.size();
+		break;
+	}
+	case Annotations::DOUBLE_ARRAY: {
+		const QVector<double> elements = unpack<double>(value);
+		annotations.doubles += elements;
+		annotations.length = elements.size();
+		break;
+	}
+	}
+}
 
 RosBagAnnotator::RosBagAnnotator(QQuickItem *parent):
 	QQuickItem(parent),
 	mStatus(EMPTY),
 	mUseRosTime(false),
+	mWindowedLoading(false),
+	mParseThreads(0),
+	mCompressTimelines(false),
+	mPrefetchFrames(8),
+	mThumbnailStride(1.0),
+	mPersistThumbnails(true),
 	mStartTime(0),
 	mEndTime(0),
-	mCurrentTime(0)
+	mCurrentTime(0),
+	mAudioStartTime(0),
+	mSeekDirection(1),
+	mDrift(0.0),
+	mRate(1.0),
+	mDroppedFrames(0),
+	mLastUpdateElapsed(0),
+	mFrameInterval(FRAME_INTERVAL),
+	mProgress(0.0),
+	mParseRate(0.0),
+	mParseEta(0.0),
+	mImageMsgs(mRegistry.store<Timeline<ImagePtr>>("Image")),
+	mAudioMsgs(mRegistry.store<Timeline<int>>("Audio")),
+	mImageHandler(mRegistry.handler("Image"))
 {
 	// By default, QQuickItem does not draw anything. If you subclass
 	// QQuickItem to create a visual item, you will need to uncomment the
@@ -38,10 +121,23 @@ RosBagAnnotator::RosBagAnnotator(QQuickItem *parent):
 	// setFlag(ItemHasContents, true);
 
 	connect(&mPlaybackTimer, &QTimer::timeout, this, &RosBagAnnotator::updatePlayback);
+	connect(&mFrameDecoder, &FrameDecoder::frameReady, this, &RosBagAnnotator::forwardFrame);
+
+	// Windows of payloads are read from the bag on the decoding threads
+	mFrameDecoder.setLoader([this](const QString &topic, uint64_t time) {
+		return mMessageCache.image(topic, time);
+	});
+
+	// Some backends only refresh the position at this interval
+	mMediaPlayer.setNotifyInterval(20);
 }
 
 RosBagAnnotator::~RosBagAnnotator()
 {
+	stopParse();
+	stopThumbnails();
+	stopEnvelopes();
+	stopAnnotationWriter();
 }
 
 void RosBagAnnotator::setBagPath(QString path) {
@@ -49,24 +145,47 @@ void RosBagAnnotator::setBagPath(QString path) {
 
 	reset();
 
-	if (!mBagPath.isEmpty()) {
-		try {
-			mBag.reset(new rosbag::Bag(mBagPath.toStdString()));
-		}
-		catch (const rosbag::BagException &e) {
-			qDebug() << "An exception has occured while opening bag " << mBagPath << ": " << e.what();
-			return;
-		}
+	if (!mTopicFilter.isEmpty()) {
+		mTopicFilter.clear();
+		emit topicFilterChanged(mTopicFilter);
+	}
 
-		parseBag();
-		
-		mBag->close();
+	if (!mBagPath.isEmpty()) {
+		startParse();
 	}
 
 	emit bagPathChanged(mBagPath);
 }
 
+void RosBagAnnotator::loadTopics(const QStringList &topics) {
+	if (mBagPath.isEmpty()) {
+		return;
+	}
+
+	// Topics are kept as they are, so that the selection can still be changed afterwards
+	stop();
+	stopParse();
+	clearMessages();
+
+	mTopicFilter = topics;
+	emit topicFilterChanged(mTopicFilter);
+
+	startParse();
+}
+
+void RosBagAnnotator::cancelParse() {
+	if (!mParser) {
+		return;
+	}
+
+	stopParse();
+
+	mStatus = EMPTY;
+	emit statusChanged(mStatus);
+}
+
 void RosBagAnnotator::setCurrentTime(double time) {
+	const uint64_t previousTime = mCurrentTime;
 	mCurrentTime = mStartTime + static_cast<uint64_t>(1e9 * time);
 
 	if (mCurrentTime < mStartTime) {
@@ -76,162 +195,247 @@ void RosBagAnnotator::setCurrentTime(double time) {
 		mCurrentTime = mEndTime;
 	}
 
-	seekCurrentMessageIndices(mBoolMsgs, mCurrentBool);
-	seekCurrentMessageIndices(mDoubleMsgs, mCurrentDouble);
-	seekCurrentMessageIndices(mIntMsgs, mCurrentInt);
-	seekCurrentMessageIndices(mStringMsgs, mCurrentString);
-	seekCurrentMessageIndices(mIntArrayMsgs, mCurrentIntArray);
-	seekCurrentMessageIndices(mDoubleArrayMsgs, mCurrentDoubleArray);
-	seekCurrentMessageIndices(mAudioMsgs, mCurrentAudio);
-	seekCurrentMessageIndices(mImageMsgs, mCurrentImage);
+	// Frames prefetched in the other direction or around the previous time would only delay the ones needed now
+	const int direction = mCurrentTime >= previousTime ? 1 : -1;
+	const uint64_t distance = direction > 0 ? mCurrentTime - previousTime : previousTime - mCurrentTime;
+	if (direction != mSeekDirection || distance > PREFETCH_JUMP) {
+		mFrameDecoder.cancelPending();
+	}
+	if (distance > 0) {
+		mSeekDirection = direction;
+	}
+
+	// Only subscribed topics are sought right away, see TimelineStore
+	mRegistry.setTime(mCurrentTime);
 
 	emit currentTimeChanged(time);
+
+	publishChangedValues();
 }
 
-void RosBagAnnotator::advance(double time) {
-	setCurrentTime(currentTime() + time);
+void RosBagAnnotator::setSubscribedTopics(const QStringList &topics) {
+	mSubscribedTopics = topics;
+	updateSubscriptions();
+	emit subscribedTopicsChanged(topics);
 }
 
-void RosBagAnnotator::rewind(double time) {
-	setCurrentTime(currentTime() - time);
+QVariantMap RosBagAnnotator::getCurrentValues() {
+	QVariantMap values;
+	for (Subscription &subscription : mSubscriptions) {
+		const TopicRegistry::Entry &entry = subscription.entry;
+		subscription.lastCursor = entry.handler->cursor(entry.handle);
+		values.insert(subscription.topic, subscription.lastCursor < 0 ? QVariant() : entry.handler->value(entry.handle, subscription.lastCursor));
+	}
+	return values;
 }
 
-double RosBagAnnotator::findPreviousTime(const QString &topic) {
-	assert(mTopics.find(topic) != mTopics.end());
+void RosBagAnnotator::updateSubscriptions() {
+	mSubscriptions.clear();
+	mRegistry.clearActive();
 
-	uint64_t prevTime = mCurrentTime;
-	const QString &type = mTopics[topic].toString();
+	for (const QString &topic : mSubscribedTopics) {
+		const TopicRegistry::Entry *entry = mRegistry.find(topic);
+		if (!entry) {
+			if (mStatus == READY) {
+				qDebug() << "Cannot subscribe to topic" << topic << "which has not been extracted";
+			}
+			continue;
+		}
 
-	if (type == "Bool") {
-		prevTime = previousMessageTime(mBoolMsgs[topic], mCurrentBool[topic]);
-	}
-	else if (type == "Double") {
-		prevTime = previousMessageTime(mDoubleMsgs[topic], mCurrentDouble[topic]);
-	}
-	else if (type == "Int") {
-		prevTime = previousMessageTime(mIntMsgs[topic], mCurrentInt[topic]);
-	}
-	else if (type == "String") {
-		prevTime = previousMessageTime(mStringMsgs[topic], mCurrentString[topic]);
-	}
-	else if (type == "IntArray") {
-		prevTime = previousMessageTime(mIntArrayMsgs[topic], mCurrentIntArray[topic]);
-	}
-	else if (type == "DoubleArray") {
-		prevTime = previousMessageTime(mDoubleArrayMsgs[topic], mCurrentDoubleArray[topic]);
+		entry->handler->setActive(entry->handle, true);
+
+		// Images are decoded asynchronously, they are delivered through getCurrentValue and frameReady
+		if (entry->handler != mImageHandler) {
+			Subscription subscription;
+			subscription.topic = topic;
+			subscription.entry = *entry;
+			subscription.lastCursor = entry->handler->cursor(entry->handle);
+			mSubscriptions.append(subscription);
+		}
 	}
-	else if (type == "Audio") {
-		prevTime = previousMessageTime(mAudioMsgs[topic], mCurrentAudio[topic]);
+}
+
+void RosBagAnnotator::publishChangedValues() {
+	QVariantMap changed;
+
+	// Only topics whose message changed pay for building their value
+	for (Subscription &subscription : mSubscriptions) {
+		const TopicRegistry::Entry &entry = subscription.entry;
+		const int cursor = entry.handler->cursor(entry.handle);
+		if (cursor != subscription.lastCursor) {
+			subscription.lastCursor = cursor;
+			changed.insert(subscription.topic, cursor < 0 ? QVariant() : entry.handler->value(entry.handle, cursor));
+		}
 	}
-	else if (type == "Image") {
-		prevTime = previousMessageTime(mImageMsgs[topic], mCurrentImage[topic]);
+
+	if (!changed.isEmpty()) {
+		emit valuesChanged(changed);
 	}
+}
+
+void RosBagAnnotator::advance(double time) {
+	setCurrentTime(currentTime() + time);
+}
+
+void RosBagAnnotator::rewind(double time) {
+	setCurrentTime(currentTime() - time);
+}
+
+double RosBagAnnotator::findPreviousTime(int topicId) {
+	const TopicRegistry::Entry *entry = mRegistry.entry(topicId);
+	const uint64_t prevTime = entry ? previousMessageTime(*entry) : mCurrentTime;
 
 	return std::max(1e-9 * (prevTime - mStartTime), 0.0);
 }
 
-double RosBagAnnotator::findNextTime(const QString &topic) {
-	assert(mTopics.find(topic) != mTopics.end());
+double RosBagAnnotator::findNextTime(int topicId) {
+	const TopicRegistry::Entry *entry = mRegistry.entry(topicId);
+	const uint64_t nextTime = entry ? nextMessageTime(*entry) : mCurrentTime;
 
-	uint64_t nextTime = mCurrentTime;
-	const QString &type = mTopics[topic].toString();
+	return std::min(1e-9 * (nextTime - mStartTime), 1e-9 * (mEndTime - mStartTime));
+}
 
-	if (type == "Bool") {
-		nextTime = nextMessageTime(mBoolMsgs[topic], mCurrentBool[topic]);
+uint64_t RosBagAnnotator::previousMessageTime(const TopicRegistry::Entry &entry) const {
+	int current = entry.handler->cursor(entry.handle);
+	if (current < 0) {
+		return mCurrentTime;
 	}
-	else if (type == "Double") {
-		nextTime = nextMessageTime(mDoubleMsgs[topic], mCurrentDouble[topic]);
+
+	if (entry.handler->time(entry.handle, current) < mCurrentTime) {
+		return entry.handler->time(entry.handle, current);
 	}
-	else if (type == "Int") {
-		nextTime = nextMessageTime(mIntMsgs[topic], mCurrentInt[topic]);
+
+	if (current > 0) {
+		current -= 1;
 	}
-	else if (type == "String") {
-		nextTime = nextMessageTime(mStringMsgs[topic], mCurrentString[topic]);
+
+	return entry.handler->time(entry.handle, current);
+}
+
+uint64_t RosBagAnnotator::nextMessageTime(const TopicRegistry::Entry &entry) const {
+	const int next = entry.handler->cursor(entry.handle) + 1;
+	if (next >= entry.handler->size(entry.handle)) {
+		return mCurrentTime;
 	}
-	else if (type == "IntArray") {
-		nextTime = nextMessageTime(mIntArrayMsgs[topic], mCurrentIntArray[topic]);
+	else {
+		return entry.handler->time(entry.handle, next);
 	}
-	else if (type == "DoubleArray") {
-		nextTime = nextMessageTime(mDoubleArrayMsgs[topic], mCurrentDoubleArray[topic]);
+}
+
+QVariant RosBagAnnotator::getCurrentValue(int topicId) {
+	const TopicRegistry::Entry *entry = mRegistry.entry(topicId);
+	if (!entry) {
+		return QVariant();
 	}
-	else if (type == "Audio") {
-		nextTime = nextMessageTime(mAudioMsgs[topic], mCurrentAudio[topic]);
+
+	const int current = entry->handler->cursor(entry->handle);
+	if (current < 0) {
+		return QVariant();
 	}
-	else if (type == "Image") {
-		nextTime = nextMessageTime(mImageMsgs[topic], mCurrentImage[topic]);
+
+	if (entry->handler != mImageHandler) {
+		return entry->handler->value(entry->handle, current);
 	}
 
-	return std::min(1e-9 * (nextTime - mStartTime), 1e-9 * (mEndTime - mStartTime));
-}
+	QVector<FrameDecoder::Request> requests;
+	updateDisplayedFrame(mFrameStates[false], entry->handle, current, requests);
+	mFrameDecoder.request(requests, true);
 
-QVariant RosBagAnnotator::getCurrentValue(const QString &topic) {
-	static sensor_msgs::CompressedImage::ConstPtr lastImagePtr = nullptr;
-	static QImage lastImage;
+	prefetchImages(entry->handle, current);
 
-	QVariant value;
+	return displayedFrame(mFrameStates[false], mImageMsgs.topic(entry->handle));
+}
 
-	auto it = mTopics.find(topic);
-	if (it == mTopics.end()) {
-		return value;
-	}
+QVariantList RosBagAnnotator::getAlignedFrames(const QList<int> &topicIds, bool nearest) {
+	QVariantList frames;
+	frames.reserve(topicIds.size());
 
-	const QString type = it.value().toString();
+	FrameState &state = mFrameStates[nearest];
+	QVector<FrameDecoder::Request> requests;
+	QVector<QPair<int, int>> shown;
 
-	if (type == "Bool") {
-		auto it = mCurrentBool[topic];
-		if (it >= mBoolMsgs[topic].begin()) {
-			value = it->second;
-		}
-	}
-	else if (type == "Double") {
-		auto it = mCurrentDouble[topic];
-		if (it >= mDoubleMsgs[topic].begin()) {
-			value = it->second;
+	for (int topicId : topicIds) {
+		const TopicRegistry::Entry *entry = mRegistry.entry(topicId);
+		const int handle = entry && entry->handler == mImageHandler ? entry->handle : -1;
+		int index = handle >= 0 ? mImageMsgs.cursor(handle) : -1;
+
+		if (handle >= 0 && nearest) {
+			const Timeline<ImagePtr> &messages = mImageMsgs[handle];
+			const int next = index + 1;
+			if (next < messages.size() && (index < 0 || messages.time(next) - mCurrentTime < mCurrentTime - messages.time(index))) {
+				index = next;
+			}
 		}
-	}
-	else if (type == "Int") {
-		auto it = mCurrentInt[topic];
-		if (it >= mIntMsgs[topic].begin()) {
-			value = it->second;
+
+		if (index >= 0) {
+			updateDisplayedFrame(state, handle, index, requests);
+			shown.append(qMakePair(handle, index));
 		}
 	}
-	else if (type == "String") {
-		auto it = mCurrentString[topic];
-		if (it >= mStringMsgs[topic].begin()) {
-			value = it->second;
-		}
+
+	// Frames of all topics missing from the cache are decoded side by side
+	mFrameDecoder.request(requests, true);
+
+	for (const auto &frame : shown) {
+		prefetchImages(frame.first, frame.second);
 	}
-	else if (type == "IntArray") {
-		auto it = mCurrentIntArray[topic];
-		if (it >= mIntArrayMsgs[topic].begin()) {
-			value = it->second;
-		}
+
+	for (int topicId : topicIds) {
+		const TopicRegistry::Entry *entry = mRegistry.entry(topicId);
+		frames.append(entry && entry->handler == mImageHandler ? displayedFrame(state, mImageMsgs.topic(entry->handle)) : QVariant());
 	}
-	else if (type == "DoubleArray") {
-		auto it = mCurrentDoubleArray[topic];
-		if (it >= mDoubleArrayMsgs[topic].begin()) {
-			value = it->second;
-		}
+
+	return frames;
+}
+
+QVariantMap RosBagAnnotator::getAudioEnvelope(const QString &topic, double start, double end, int maxBuckets) {
+	QVariantMap envelope;
+
+	auto it = mAudioEnvelopes.constFind(topic);
+	if (it == mAudioEnvelopes.constEnd()) {
+		return envelope;
 	}
-	else if (type == "Audio") {
-		auto it = mCurrentAudio[topic];
-		if (it >= mAudioMsgs[topic].begin()) {
-			value = it->second;
+
+	const AudioEnvelope::Range range = (*it)->query(mStartTime + static_cast<uint64_t>(std::max(start, 0.0) * 1e9),
+													mStartTime + static_cast<uint64_t>(std::max(end, 0.0) * 1e9), maxBuckets);
+
+	auto toList = [](const QVector<float> &values) {
+		QVariantList list;
+		list.reserve(values.size());
+		for (float value : values) {
+			list.append(value);
 		}
+		return list;
+	};
+
+	envelope.insert("start", 1e-9 * (static_cast<qint64>(range.start) - static_cast<qint64>(mStartTime)));
+	envelope.insert("duration", 1e-9 * range.duration);
+	envelope.insert("min", toList(range.min));
+	envelope.insert("max", toList(range.max));
+	envelope.insert("rms", toList(range.rms));
+
+	return envelope;
+}
+
+QVariantMap RosBagAnnotator::getSeries(int topicId, double start, double end, int maxPoints) {
+	const TopicRegistry::Entry *entry = mRegistry.entry(topicId);
+	if (!entry || maxPoints <= 0 || end < start) {
+		return QVariantMap();
 	}
-	else if (type == "Image") {
-		auto it = mCurrentImage[topic];
-		if (it >= mImageMsgs[topic].begin()) {
-			if (it->second != lastImagePtr) {
-				lastImagePtr = it->second;
-				lastImage.loadFromData(lastImagePtr->data.data(), lastImagePtr->data.size(), lastImagePtr->format.c_str());
-			}
 
-			value = lastImage;
-		}
+	const uint64_t startTime = mStartTime + static_cast<uint64_t>(std::max(start, 0.0) * 1e9);
+	const uint64_t endTime = mStartTime + static_cast<uint64_t>(std::max(end, 0.0) * 1e9);
+
+	return entry->handler->series(entry->handle, mSeriesPyramids[topicId], startTime, endTime, maxPoints, mStartTime);
+}
+
+QVariant RosBagAnnotator::getThumbnail(const QString &topic, double time) {
+	const QImage thumbnail = mThumbnails.nearest(topic, mStartTime + static_cast<uint64_t>(std::max(time, 0.0) * 1e9));
+	if (thumbnail.isNull()) {
+		return QVariant();
 	}
 
-	return value;
+	return thumbnail;
 }
 
 void RosBagAnnotator::play(double frequency, const QString &audioTopic) {
@@ -240,350 +444,733 @@ void RosBagAnnotator::play(double frequency, const QString &audioTopic) {
 	mPlaybackStartTime = mCurrentTime;
 	mAudioTopic = audioTopic;
 
-	mPlaybackTimer.setTimerType(Qt::PreciseTimer);
-	mPlaybackTimer.setInterval(1e3 / frequency);
+	mDrift = 0.0;
+	emit driftChanged(mDrift);
+
+	mDroppedFrames = 0;
+	emit droppedFramesChanged(mDroppedFrames);
+	for (FrameState &state : mFrameStates) {
+		state.late.clear();
+	}
 
 	mPlaybackElapsedTimer.start();
-	mPlaybackTimer.start();
+	mLastUpdateElapsed = 0;
+
+	// Playback advances once per frame of the window, so video is paced by its refresh rate;
+	// the timer only drives playback when the item is not shown in any window
+	if (window()) {
+		mFrameConnection = connect(window(), &QQuickWindow::afterAnimating, this, &RosBagAnnotator::updatePlayback);
+		window()->update();
+	}
+	else {
+		mPlaybackTimer.setTimerType(Qt::PreciseTimer);
+		mPlaybackTimer.setInterval(1e3 / frequency);
+		mPlaybackTimer.start();
+	}
 
 	emit playingChanged(true);
 }
 
 void RosBagAnnotator::stop() {
 	mPlaybackTimer.stop();
+	disconnect(mFrameConnection);
+	mFrameConnection = QMetaObject::Connection();
 
 	mMediaPlayer.stop();
 	mMediaPlayer.setMedia(QMediaContent());
-	if (mAudioBuffer.isOpen()) {
-		mAudioBuffer.close();
+	mAudioStream.reset();
+
+	if (mAnnotationWriter) {
+		mAnnotationWriter->flush();
 	}
 
 	emit playingChanged(false);
 }
 
+void RosBagAnnotator::setRate(double rate) {
+	if (rate == 0.0 || rate == mRate) {
+		return;
+	}
+
+	mRate = rate;
+
+	// The clock restarts from the current time at the new rate, and audio is restarted at the
+	// new rate by the next update, unless it has to be muted
+	if (playing()) {
+		mPlaybackStartTime = mCurrentTime;
+		mPlaybackElapsedTimer.restart();
+		mLastUpdateElapsed = 0;
+
+		mMediaPlayer.stop();
+		mMediaPlayer.setMedia(QMediaContent());
+		mAudioStream.reset();
+	}
+
+	emit rateChanged(rate);
+}
+
 void RosBagAnnotator::annotate(const QString &topic, const QVariant &value, const AnnotationType type) {
 	// Input validation should occur before passing a value to this function.
 	// Invalid inputs will result in default-constructed values being written to the bag.
-	if (type == BOOL) {
-		std_msgs::Bool msg;
-		msg.data = value.toBool();
-		publishAnnotation(topic, type, msg);
-	}
-	else if (type == INT) {
-		std_msgs::Int32 msg;
-		msg.data = value.toInt();
-		publishAnnotation(topic, type, msg);
-	}
-	else if (type == DOUBLE) {
-		std_msgs::Float64 msg;
-		msg.data = value.toDouble();
-		publishAnnotation(topic, type, msg);
-	}
-	else if (type == STRING) {
-		std_msgs::String msg;
-		msg.data = value.toString().toStdString();
-		publishAnnotation(topic, type, msg);
-	}
-	else if (type == INT_ARRAY || type == DOUBLE_ARRAY) {
-		QJSValue jsValue = value.value<QJSValue>();
-		int length = jsValue.property("length").toInt();
-
-		if (type == INT_ARRAY) {
-			std_msgs::Int32MultiArray msg;
-			for (int i = 0; i < length; ++i) {
-				msg.data.push_back(jsValue.property(i).toInt());
-			}
-			publishAnnotation(topic, type, msg);
+	Annotations annotations;
+	annotations.type = static_cast<Annotations::Type>(type);
+	annotations.times.append(mCurrentTime);
+	appendValue(annotations, value);
+
+	publishAnnotations(topic, annotations);
+}
+
+void RosBagAnnotator::annotateRange(const QString &topic, double start, double end, const QVariant &value,
+									const AnnotationType type, double rate) {
+	if (rate <= 0.0 || end < start) {
+		qDebug() << "Cannot annotate range from" << start << "to" << end << "at" << rate << "Hz";
+		return;
+	}
+
+	const uint64_t startTime = mStartTime + static_cast<uint64_t>(std::max(start, 0.0) * 1e9);
+	const uint64_t endTime = std::min(mStartTime + static_cast<uint64_t>(std::max(end, 0.0) * 1e9), mEndTime);
+	if (startTime > endTime) {
+		return;
+	}
+
+	// The value is converted once, every message of the range repeating it
+	Annotations row;
+	row.type = static_cast<Annotations::Type>(type);
+	row.times.append(startTime);
+	appendValue(row, value);
+
+	const double period = 1e9 / rate;
+	const double count = std::floor((endTime - startTime) / period) + 1;
+	if (count * std::max(row.isArray() ? row.length : 1, 1) > MAX_RANGE_VALUES) {
+		qDebug() << "Cannot annotate" << count << "messages from" << start << "to" << end << "at once";
+		return;
+	}
+
+	Annotations annotations;
+	annotations.type = row.type;
+	annotations.length = row.length;
+	annotations.times.reserve(static_cast<int>(count));
+	annotations.ints.reserve(static_cast<int>(count) * row.ints.size());
+	annotations.doubles.reserve(static_cast<int>(count) * row.doubles.size());
+
+	for (qint64 i = 0; i < static_cast<qint64>(count); ++i) {
+		const uint64_t time = startTime + static_cast<uint64_t>(i * period);
+		if (time > endTime) {
+			break;
 		}
-		else {
-			std_msgs::Float64MultiArray msg;
-			for (int i = 0; i < length; ++i) {
-				msg.data.push_back(jsValue.property(i).toInt());
-			}
-			publishAnnotation(topic, type, msg);
+
+		annotations.times.append(time);
+		annotations.ints += row.ints;
+		annotations.doubles += row.doubles;
+		annotations.strings += row.strings;
+	}
+
+	publishAnnotations(topic, annotations);
+}
+
+void RosBagAnnotator::annotateBatch(const QString &topic, const QVariant &times, const QVariant &values,
+									const AnnotationType type) {
+	const QVector<double> seconds = unpack<double>(times);
+	const int count = seconds.size();
+
+	Annotations annotations;
+	annotations.type = static_cast<Annotations::Type>(type);
+
+	switch (annotations.type) {
+	case Annotations::BOOL:
+		for (quint8 value : unpack<quint8>(values)) {
+			annotations.ints.append(value != 0 ? 1 : 0);
+		}
+		break;
+	case Annotations::INT:
+	case Annotations::INT_ARRAY:
+		annotations.ints = unpack<qint32>(values);
+		break;
+	case Annotations::DOUBLE:
+	case Annotations::DOUBLE_ARRAY:
+		annotations.doubles = unpack<double>(values);
+		break;
+	case Annotations::STRING:
+		for (const QVariant &value : fromQml(values).toList()) {
+			annotations.strings.append(value.toString());
+		}
+		break;
+	}
+
+	// Every message of a batch has as many elements, so arrays are packed one after the other
+	if (annotations.isArray() && count > 0) {
+		const int total = annotations.type == Annotations::INT_ARRAY ? annotations.ints.size() : annotations.doubles.size();
+		annotations.length = total % count == 0 ? total / count : -1;
+	}
+
+	// Like ranges, times are kept within the bag, past which seeking and playback never go
+	const double bagLength = length();
+	annotations.times.resize(count);
+	for (int i = 0; i < count; ++i) {
+		const double time = std::min(std::max(seconds[i], 0.0), bagLength);
+		annotations.times[i] = std::min(mStartTime + static_cast<uint64_t>(time * 1e9), mEndTime);
+	}
+
+	if (!annotations.isValid()) {
+		qDebug() << "Cannot annotate" << count << "times with the values given";
+		return;
+	}
+
+	publishAnnotations(topic, annotations);
+}
+
+void RosBagAnnotator::publishAnnotations(const QString &topic, const Annotations &annotations) {
+	if (mStatus != READY) {
+		qDebug() << "Cannot publish annotation because bag isn't ready!";
+		return;
+	}
+
+	// An empty range or batch does not create its topic either
+	if (annotations.isEmpty()) {
+		return;
+	}
+
+	const AnnotationType type = static_cast<AnnotationType>(annotations.type);
+
+	auto it = mAnnotationTopics.find(topic);
+	if (it != mAnnotationTopics.end()) {
+		if (it->value<AnnotationType>() != type) {
+			qDebug() << "Cannot publish different type to existing topic!";
+			return;
 		}
 	}
+	else {
+		mAnnotationTopics.insert(topic, type);
+		emit annotationTopicsChanged(mAnnotationTopics);
+	}
+
+	if (!mAnnotationWriter || mAnnotationWriter->bagPath() != annotationBagPath()) {
+		startAnnotationWriter();
+	}
+
+	mAnnotationWriter->write(topic, annotations);
+
+	insertAnnotations(topic, annotations);
+
+	// Once per published batch, however many messages it merged
+	emit messageCountsChanged(mMessageCounts);
+	publishChangedValues();
+}
+
+void RosBagAnnotator::insertAnnotations(const QString &topic, const Annotations &annotations) {
+	const QString annotationTopic = "/annotation/" + topic;
+	TopicHandler *handler = mRegistry.annotationHandler(annotations.type);
+
+	// A topic left out of extraction would only hold the annotations made since
+	if (!handler || (mTopics.contains(annotationTopic) && handler->handle(annotationTopic) < 0)) {
+		return;
+	}
+
+	handler->annotate(annotationTopic, annotations);
+
+	mMessageCounts.insert(annotationTopic, mMessageCounts.value(annotationTopic).toInt() + annotations.size());
+
+	if (!mTopics.contains(annotationTopic)) {
+		const QString type = handler->type();
+		mTopics.insert(annotationTopic, type);
+		QVariantList topics = mTopicsByType.value(type).toList();
+		topics.append(annotationTopic);
+		mTopicsByType.insert(type, topics);
+
+		mRegistry.resolve(mTopics);
+		updateSubscriptions();
+
+		emit topicsChanged(mTopics);
+		emit topicsByTypeChanged(mTopicsByType);
+	}
+
+	mSeriesPyramids.remove(mRegistry.id(annotationTopic));
+}
+
+QString RosBagAnnotator::annotationBagPath() const {
+	QString path = mBagPath;
+	if (mUseSeparateBag) {
+		path.replace(".bag", "-annotations.bag");
+	}
+	return path;
+}
+
+void RosBagAnnotator::startAnnotationWriter() {
+	stopAnnotationWriter();
+
+	// Annotations a crash left in the journal are written as soon as the writer starts,
+	// and shown along with the ones parsed from the bag
+	mAnnotationWriter.reset(new AnnotationWriter(annotationBagPath()));
+	connect(mAnnotationWriter.get(), &AnnotationWriter::recovered, this, &RosBagAnnotator::insertRecovered);
+	connect(mAnnotationWriter.get(), &AnnotationWriter::journalFailed, this, &RosBagAnnotator::annotationJournalFailed);
+	mAnnotationWriter->start(QThread::LowPriority);
+}
+
+void RosBagAnnotator::stopAnnotationWriter() {
+	if (!mAnnotationWriter) {
+		return;
+	}
+
+	mAnnotationWriter->disconnect(this);
+	mAnnotationWriter->stop();
+	mAnnotationWriter->wait();
+	mAnnotationWriter.reset();
+}
+
+void RosBagAnnotator::insertRecovered(const QString &topic, const Annotations &annotations) {
+	// Only the current writer recovers annotations of the bag that was parsed
+	if (sender() != mAnnotationWriter.get() || mStatus != READY) {
+		return;
+	}
+
+	const AnnotationType type = static_cast<AnnotationType>(annotations.type);
+
+	auto it = mAnnotationTopics.find(topic);
+	if (it != mAnnotationTopics.end()) {
+		if (it->value<AnnotationType>() != type) {
+			return;
+		}
+	}
+	else {
+		mAnnotationTopics.insert(topic, type);
+		emit annotationTopicsChanged(mAnnotationTopics);
+	}
+
+	insertAnnotations(topic, annotations);
+
+	emit messageCountsChanged(mMessageCounts);
+	publishChangedValues();
 }
 
 void RosBagAnnotator::updatePlayback() {
-	uint64_t currentTime = mPlaybackStartTime + mPlaybackElapsedTimer.nsecsElapsed();
+	const qint64 elapsed = mPlaybackElapsedTimer.nsecsElapsed();
+	qint64 currentTime = static_cast<qint64>(mPlaybackStartTime) + static_cast<qint64>(mRate * elapsed);
+
+	// Smoothed, to predict which frames the next updates will show
+	mFrameInterval += (elapsed - mLastUpdateElapsed - mFrameInterval) / 8;
+	mLastUpdateElapsed = elapsed;
+
+	// While audio is heard, it is the master clock and the playback clock is slewed towards it
+	if (mAudioStream && mMediaPlayer.mediaStatus() == QMediaPlayer::BufferedMedia) {
+		const qint64 audioTime = mAudioStartTime + mMediaPlayer.position() * 1000000;
+		const qint64 drift = currentTime - audioTime;
+		const qint64 correction = std::abs(drift) > DRIFT_RESYNC ? drift : drift / DRIFT_SLEW;
+
+		mPlaybackStartTime -= correction;
+		currentTime -= correction;
 
-	if (currentTime > mEndTime) {
+		mDrift = 1e-9 * drift;
+		emit driftChanged(mDrift);
+	}
+
+	if (currentTime > static_cast<qint64>(mEndTime) || currentTime < static_cast<qint64>(mStartTime)) {
 		stop();
 	}
 	else {
 		setCurrentTime(1e-9 * (currentTime - mStartTime));
 
-		if (mMediaPlayer.state() != QMediaPlayer::PlayingState) {
+		if (mMediaPlayer.state() != QMediaPlayer::PlayingState && mRate >= MIN_AUDIO_RATE && mRate <= MAX_AUDIO_RATE) {
 			playAudio(mAudioTopic);
 		}
+
+		// Schedules the next frame, and with it the next update
+		if (mFrameConnection && window()) {
+			window()->update();
+		}
 	}
 }
 
 void RosBagAnnotator::reset() {
 	stop();
+	stopParse();
+	stopAnnotationWriter();
 
 	mStartTime = mEndTime = mCurrentTime = 0;
 
 	mTopics.clear();
 	mTopicsByType.clear();
+	mMessageCounts.clear();
 
-	mCurrentBool.clear();
-	mCurrentDouble.clear();
-	mCurrentInt.clear();
-	mCurrentString.clear();
-	mCurrentIntArray.clear();
-	mCurrentDoubleArray.clear();
-	mCurrentAudio.clear();
-	mCurrentImage.clear();
-
-	mBoolMsgs.clear();
-	mDoubleMsgs.clear();
-	mIntMsgs.clear();
-	mStringMsgs.clear();
-	mIntArrayMsgs.clear();
-	mDoubleArrayMsgs.clear();
-	mAudioMsgs.clear();
-	mImageMsgs.clear();
-
-	mAudioByteArrays.clear();
+	clearMessages();
 
 	mStatus = EMPTY;
 	emit statusChanged(mStatus);
 	emit lengthChanged(length());
 	emit topicsChanged(mTopics);
 	emit topicsByTypeChanged(mTopicsByType);
+	emit messageCountsChanged(mMessageCounts);
 	emit currentTimeChanged(0.0);
 }
 
-void RosBagAnnotator::parseBag() {
+void RosBagAnnotator::clearMessages() {
+	// Topic ids of the previous bag or selection are no longer valid
+	mSubscriptions.clear();
+	mRegistry.clear();
+
+	// Decoding threads may be reading payloads of the previous bag
+	mFrameDecoder.clear();
+	mMessageCache.setBagPath(mBagPath);
+
+	mMemorySavings.clear();
+	emit memorySavingsChanged(mMemorySavings);
+
+	for (FrameState &state : mFrameStates) {
+		state.displayed.clear();
+		state.late.clear();
+	}
+
+	stopThumbnails();
+	mThumbnails.clear();
+
+	stopEnvelopes();
+	mAudioEnvelopes.clear();
+
+	mSeriesPyramids.clear();
+
+	mProgress = mParseRate = mParseEta = 0.0;
+	emit progressChanged(mProgress);
+	emit parseRateChanged(mParseRate);
+	emit parseEtaChanged(mParseEta);
+}
+
+void RosBagAnnotator::startParse() {
+	ParseOptions options;
+	options.useRosTime = mUseRosTime;
+	options.topicFilter = mTopicFilter;
+	options.windowed = mWindowedLoading;
+	options.threads = mParseThreads;
+	options.compress = mCompressTimelines;
+
+	mParser.reset(new BagParser(mBagPath, options));
+	connect(mParser.get(), &BagParser::metadataReady, this, &RosBagAnnotator::applyMetadata);
+	connect(mParser.get(), &BagParser::progressChanged, this, &RosBagAnnotator::updateParseProgress);
+	connect(mParser.get(), &QThread::finished, this, &RosBagAnnotator::finishParse);
+
 	mStatus = PARSING;
 	emit statusChanged(mStatus);
 
-	mStartTime = std::numeric_limits<uint64_t>::max();
-	mEndTime = 0;
+	mParser->start();
+}
+
+void RosBagAnnotator::stopParse() {
+	if (!mParser) {
+		return;
+	}
+
+	// Results of a cancelled parser are thrown away, so there is no point in delivering its signals
+	mParser->disconnect(this);
+	mParser->cancel();
+	mParser->wait();
+	mParser.reset();
+}
+
+void RosBagAnnotator::startThumbnails() {
+	QStringList topics;
+	for (int handle = 0; handle < mImageMsgs.count(); ++handle) {
+		topics.append(mImageMsgs.topic(handle));
+	}
+
+	if (topics.isEmpty() || mThumbnailStride <= 0.0) {
+		return;
+	}
+
+	// Reads the bag on its own, so it does not compete with playback for the message cache
+	mThumbnailBuilder.reset(new ThumbnailBuilder(mBagPath, topics, static_cast<uint64_t>(mThumbnailStride * 1e9),
+												 mPersistThumbnails, &mThumbnails));
+	mThumbnailBuilder->start(QThread::LowPriority);
+}
+
+void RosBagAnnotator::stopThumbnails() {
+	if (!mThumbnailBuilder) {
+		return;
+	}
+
+	mThumbnailBuilder->cancel();
+	mThumbnailBuilder->wait();
+	mThumbnailBuilder.reset();
+}
+
+void RosBagAnnotator::startEnvelopes() {
+	for (int handle = 0; handle < mAudioMsgs.count(); ++handle) {
+		if (!mAudioMsgs[handle].isEmpty()) {
+			mAudioEnvelopes.insert(mAudioMsgs.topic(handle), std::make_shared<AudioEnvelope>(mAudioMsgs[handle].time(0)));
+		}
+	}
+
+	if (mAudioEnvelopes.isEmpty()) {
+		return;
+	}
+
+	mAudioEnvelopeBuilder.reset(new AudioEnvelopeBuilder(mBagPath, mAudioEnvelopes));
+	connect(mAudioEnvelopeBuilder.get(), &AudioEnvelopeBuilder::envelopeChanged, this, &RosBagAnnotator::audioEnvelopeChanged);
+	mAudioEnvelopeBuilder->start(QThread::LowPriority);
+}
+
+void RosBagAnnotator::stopEnvelopes() {
+	if (!mAudioEnvelopeBuilder) {
+		return;
+	}
+
+	mAudioEnvelopeBuilder->disconnect(this);
+	mAudioEnvelopeBuilder->cancel();
+	mAudioEnvelopeBuilder->wait();
+	mAudioEnvelopeBuilder.reset();
+}
+
+void RosBagAnnotator::applyMetadata(const QVariantMap &topics, const QVariantMap &topicsByType,
+									const QVariantMap &annotationTopics, const QVariantMap &messageCounts,
+									quint64 startTime, quint64 endTime) {
+	if (!mParser || sender() != mParser.get()) {
+		return;
+	}
+
+	// Messages are still being extracted, so only the topic list and the time span are usable yet
+	mStartTime = mCurrentTime = startTime;
+	mEndTime = endTime;
+
+	mTopics = topics;
+	mTopicsByType = topicsByType;
+	mMessageCounts = messageCounts;
+
+	mergeAnnotationTopics(annotationTopics);
+
+	emit lengthChanged(length());
+	emit topicsChanged(mTopics);
+	emit topicsByTypeChanged(mTopicsByType);
+	emit messageCountsChanged(mMessageCounts);
+}
+
+void RosBagAnnotator::updateParseProgress(double progress, double messagesPerSecond, double eta) {
+	if (!mParser || sender() != mParser.get()) {
+		return;
+	}
+
+	mProgress = progress;
+	mParseRate = messagesPerSecond;
+	mParseEta = eta;
+
+	emit progressChanged(mProgress);
+	emit parseRateChanged(mParseRate);
+	emit parseEtaChanged(mParseEta);
+}
+
+void RosBagAnnotator::finishParse() {
+	// Ignore notifications that were already queued by a parser that has since been stopped
+	if (!mParser || sender() != mParser.get()) {
+		return;
+	}
 
-	rosbag::View view(*mBag);
+	std::unique_ptr<BagParser> parser(std::move(mParser));
+	parser->wait();
 
-	for (auto it = view.begin(); it != view.end(); ++it)
-	{
-		extractMessage(*it);
+	if (parser->cancelled() || parser->failed()) {
+		mStatus = EMPTY;
+		emit statusChanged(mStatus);
+		return;
 	}
 
+	// Swap all stores at once, so the interface never observes a partially parsed bag
+	BagData &data = parser->data();
+	mStartTime = data.startTime;
+	mEndTime = data.endTime;
 	mCurrentTime = mStartTime;
 
-	sortMessages(mBoolMsgs);
-	sortMessages(mDoubleMsgs);
-	sortMessages(mIntMsgs);
-	sortMessages(mStringMsgs);
-	sortMessages(mIntArrayMsgs);
-	sortMessages(mDoubleArrayMsgs);
+	mTopics.swap(data.topics);
+	mTopicsByType.swap(data.topicsByType);
+
+	mRegistry.swap(data.messages);
+	mRegistry.resolve(mTopics);
+
+	mMemorySavings.swap(data.memorySavings);
+
+	mergeAnnotationTopics(data.annotationTopics);
 
 	emit lengthChanged(length());
 	emit topicsChanged(mTopics);
 	emit topicsByTypeChanged(mTopicsByType);
+	emit memorySavingsChanged(mMemorySavings);
+
+	mStatus = READY;
+	updateSubscriptions();
 
 	setCurrentTime(0.0);
 
-	mStatus = READY;
 	emit statusChanged(mStatus);
+
+	startThumbnails();
+	startEnvelopes();
+	startAnnotationWriter();
 }
 
-void RosBagAnnotator::extractMessage(const rosbag::MessageInstance &msg) {
-	const QString topic(msg.getTopic().c_str());
-	QString type(msg.getDataType().c_str());
-	uint64_t time = msg.getTime().toNSec();
-
-//	if (type == "chili_msgs/Bool") {
-//		type = "Bool";
-//		chili_msgs::Bool::ConstPtr m = msg.instantiate<chili_msgs::Bool>();
-//		if (!mUseRosTime) {
-//			time = extractChiliMessageTime(m);
-//		}
-
-//		mBoolMsgs[topic].append(QPair<uint64_t, bool>(time, m->value));
-//	}
-//	else if (type == "chili_msgs/Double") {
-//		type = "Double";
-//		chili_msgs::Double::ConstPtr m = msg.instantiate<chili_msgs::Double>();
-//		if (!mUseRosTime) {
-//			time = extractChiliMessageTime(m);
-//		}
-
-//		mDoubleMsgs[topic].append(QPair<uint64_t, double>(time, m->value));
-//	}
-//	else if (type == "chili_msgs/Int"){
-//		type = "Int";
-//		chili_msgs::Int::ConstPtr m = msg.instantiate<chili_msgs::Int>();
-//		if (!mUseRosTime) {
-//			time = extractChiliMessageTime(m);
-//		}
-
-//		mIntMsgs[topic].append(QPair<uint64_t, int>(time, m->value));
-//	}
-//	else if (type == "chili_msgs/String"){
-//		type = "String";
-//		chili_msgs::String::ConstPtr m = msg.instantiate<chili_msgs::String>();
-//		if (!mUseRosTime) {
-//			time = extractChiliMessageTime(m);
-//		}
-
-//		mStringMsgs[topic].append(QPair<uint64_t, QString>(time, m->value.c_str()));
-//	}
-//	else if (type == "chili_msgs/DoubleArray"){
-//		type = "DoubleArray";
-//		chili_msgs::DoubleArray::ConstPtr m = msg.instantiate<chili_msgs::DoubleArray>();
-//		if (!mUseRosTime) {
-//			time = extractChiliMessageTime(m);
-//		}
-
-//		QList<QVariant> data;
-//		for (auto value : m->data) {
-//			data.append(value);
-//		}
-
-//		mDoubleArrayMsgs[topic].append(QPair<uint64_t, QList<QVariant>>(time, data));
-//	}
-//	else if (type == "chili_msgs/IntArray"){
-//		type = "IntArray";
-//		chili_msgs::IntArray::ConstPtr m = msg.instantiate<chili_msgs::IntArray>();
-//		if (!mUseRosTime) {
-//			time = extractChiliMessageTime(m);
-//		}
-		
-//		QList<QVariant> data;
-//		for (auto value : m->data) {
-//			data.append(value);
-//		}
-
-//		mIntArrayMsgs[topic].append(QPair<uint64_t, QList<QVariant>>(time, data));
-//	}
-     if (type == "audio_common_msgs/AudioData") {
-		type = "Audio";
-		audio_common_msgs::AudioData::ConstPtr m = msg.instantiate<audio_common_msgs::AudioData>();
-
-		if (mAudioByteArrays.find(topic) == mAudioByteArrays.end()) {
-			mAudioByteArrays.insert(topic, QByteArray());
+void RosBagAnnotator::mergeAnnotationTopics(const QVariantMap &annotationTopics) {
+	bool newAnnotationTopics = false;
+	for (auto it = annotationTopics.begin(); it != annotationTopics.end(); ++it) {
+		if (mAnnotationTopics.find(it.key()) == mAnnotationTopics.end()) {
+			mAnnotationTopics.insert(it.key(), it.value());
+			newAnnotationTopics = true;
 		}
+	}
 
-		mAudioMsgs[topic].append(QPair<uint64_t, int>(time, mAudioByteArrays[topic].size()));
-		mAudioByteArrays[topic].append(QByteArray(reinterpret_cast<const char *>(m->data.data()), m->data.size()));
-	}
-	else if (type == "sensor_msgs/CompressedImage") {
-		type = "Image";
-		sensor_msgs::CompressedImage::ConstPtr m = msg.instantiate<sensor_msgs::CompressedImage>();
-		mImageMsgs[topic].append(QPair<uint64_t, sensor_msgs::CompressedImage::ConstPtr>(time, m));
-	}
-	else if (type == "std_msgs/Bool") {
-		type = "Bool";
-		std_msgs::Bool::ConstPtr m = msg.instantiate<std_msgs::Bool>();
-		mBoolMsgs[topic].append(QPair<uint64_t, bool>(time, m->data));
-	}
-	else if (type == "std_msgs/Int32") {
-		type = "Int";
-		std_msgs::Int32::ConstPtr m = msg.instantiate<std_msgs::Int32>();
-		mIntMsgs[topic].append(QPair<uint64_t, int>(time, m->data));
-	}
-	else if (type == "std_msgs/Float32") {
-		type = "Double";
-		std_msgs::Float32::ConstPtr m = msg.instantiate<std_msgs::Float32>();
-		mDoubleMsgs[topic].append(QPair<uint64_t, float>(time, m->data));
-	}
-	else if (type == "std_msgs/Float64") {
-		type = "Double";
-		std_msgs::Float64::ConstPtr m = msg.instantiate<std_msgs::Float64>();
-		mDoubleMsgs[topic].append(QPair<uint64_t, float>(time, m->data));
-	}
-	else if (type == "std_msgs/String") {
-		type = "String";
-		std_msgs::String::ConstPtr m = msg.instantiate<std_msgs::String>();
-		mStringMsgs[topic].append(QPair<uint64_t, QString>(time, m->data.c_str()));
-	}
-	else if (type == "std_msgs/Int32MultiArray") {
-		type = "IntArray";
-		std_msgs::Int32MultiArray::ConstPtr m = msg.instantiate<std_msgs::Int32MultiArray>();
-		QList<QVariant> data;
-		for (auto value : m->data) {
-			data.append(value);
+	if (newAnnotationTopics) {
+		emit annotationTopicsChanged(mAnnotationTopics);
+	}
+}
+
+ImagePtr RosBagAnnotator::imagePayload(int handle, int index) {
+	// Payloads that are not resident are read by the decoder, see FrameDecoder::setLoader
+	ImagePtr image = mImageMsgs[handle].value(index);
+	if (!image) {
+		image = mMessageCache.cached(mImageMsgs.topic(handle), mImageMsgs[handle].time(index));
+	}
+	return image;
+}
+
+void RosBagAnnotator::updateDisplayedFrame(FrameState &state, int handle, int index,
+										   QVector<FrameDecoder::Request> &requests) {
+	const QString &topic = mImageMsgs.topic(handle);
+	const uint64_t time = mImageMsgs[handle].time(index);
+
+	// Playback moved on to another frame before the one it waited for was decoded, so that one
+	// is skipped instead of being decoded late, unless views aligning frames the other way
+	// still wait for it
+	auto late = state.late.find(topic);
+	if (late != state.late.end() && *late != time) {
+		const uint64_t skipped = *late;
+		state.late.erase(late);
+
+		if (!frameAwaited(topic, skipped)) {
+			mFrameDecoder.cancel(topic, skipped);
+
+			mDroppedFrames += 1;
+			emit droppedFramesChanged(mDroppedFrames);
 		}
-		mIntArrayMsgs[topic].append(QPair<uint64_t, QList<QVariant>>(time, data));
-	}
-	else if (type == "std_msgs/Float32MultiArray") {
-		type = "DoubleArray";
-		std_msgs::Float32MultiArray::ConstPtr m = msg.instantiate<std_msgs::Float32MultiArray>();
-		QList<QVariant> data;
-		for (auto value : m->data) {
-			data.append(value);
+	}
+
+	// The same image keeps its cache key, so that items do not upload it again
+	auto displayed = state.displayed.constFind(topic);
+	if (displayed != state.displayed.constEnd() && displayed->time == time) {
+		return;
+	}
+
+	QImage frame;
+	if (mFrameDecoder.frame(topic, time, frame)) {
+		state.displayed.insert(topic, {time, frame});
+		state.late.remove(topic);
+		return;
+	}
+
+	const ImagePtr image = imagePayload(handle, index);
+
+	// Raw images in a layout that QImage can wrap need no decoding at all
+	if (image.raw && RawImage::isZeroCopy(*image.raw)) {
+		state.displayed.insert(topic, {time, RawImage::toQImage(image.raw)});
+	}
+	else {
+		requests.append({topic, time, image});
+
+		if (playing()) {
+			state.late.insert(topic, time);
 		}
-		mDoubleArrayMsgs[topic].append(QPair<uint64_t, QList<QVariant>>(time, data));
-	}
-	else if (type == "std_msgs/Float64MultiArray") {
-		type = "DoubleArray";
-		std_msgs::Float64MultiArray::ConstPtr m = msg.instantiate<std_msgs::Float64MultiArray>();
-		QList<QVariant> data;
-		for (auto value : m->data) {
-			data.append(value);
+	}
+}
+
+QVariant RosBagAnnotator::displayedFrame(const FrameState &state, const QString &topic) const {
+	// Until the frame is decoded, the previous one of the topic stays on display
+	auto displayed = state.displayed.constFind(topic);
+	if (displayed == state.displayed.constEnd()) {
+		return QVariant();
+	}
+
+	return displayed->image;
+}
+
+bool RosBagAnnotator::frameAwaited(const QString &topic, uint64_t time) const {
+	for (const FrameState &state : mFrameStates) {
+		auto late = state.late.constFind(topic);
+		if (late != state.late.constEnd() && *late == time) {
+			return true;
 		}
-		mDoubleArrayMsgs[topic].append(QPair<uint64_t, QList<QVariant>>(time, data));
 	}
+	return false;
+}
+
+void RosBagAnnotator::prefetchImages(int handle, int current) {
+	const QString &topic = mImageMsgs.topic(handle);
+	const Timeline<ImagePtr> &messages = mImageMsgs[handle];
 
-	if (mTopics.find(topic) == mTopics.end()) {
-		mTopics.insert(topic, QVariant(type));
+	// During playback, the frames that updates will actually show are predicted from the rate,
+	// so that fast playback does not decode frames it skips over
+	const uint64_t step = playing() ? static_cast<uint64_t>(std::abs(mRate) * mFrameInterval) : 0;
+	const uint64_t currentTime = messages.time(current);
 
-		if (mTopicsByType.find(type) == mTopicsByType.end()) {
-			mTopicsByType.insert(type, QVariantList({topic}));
+	int index = current;
+	for (int i = 1; i <= mPrefetchFrames; ++i) {
+		if (mSeekDirection > 0) {
+			index = step > 0 ? std::max(messages.seek(currentTime + i * step, index), index + 1) : index + 1;
+		}
+		else if (step > 0 && i * step > currentTime) {
+			break;
 		}
 		else {
-			QVariantList tmp = mTopicsByType[type].toList();
-			tmp.append(topic);
-			mTopicsByType.insert(type, tmp);
+			index = step > 0 ? std::min(messages.seek(currentTime - i * step, index), index - 1) : index - 1;
 		}
-	}
 
-	const QString annotationPrefix("/annotation/");
-	if (topic.startsWith(annotationPrefix)) {
-		QString topicName(topic);
-		topicName.remove(0, annotationPrefix.length());
-		if (mAnnotationTopics.find(topicName) == mAnnotationTopics.end()) {
-			mAnnotationTopics.insert(topicName, type);
-			emit annotationTopicsChanged(mAnnotationTopics);
+		if (index < 0 || index >= messages.size()) {
+			break;
+		}
+
+		if (!mFrameDecoder.contains(topic, messages.time(index))) {
+			const ImagePtr image = imagePayload(handle, index);
+			if (!image.raw || !RawImage::isZeroCopy(*image.raw)) {
+				mFrameDecoder.request(topic, messages.time(index), image, false);
+			}
 		}
 	}
+}
 
+void RosBagAnnotator::forwardFrame(const QString &topic, quint64 time) {
 	if (time < mStartTime) {
-		mStartTime = time;
+		return;
 	}
 
-	if (time > mEndTime) {
-		mEndTime = time;
-	}
+	emit frameReady(topic, 1e-9 * (time - mStartTime));
 }
 
 void RosBagAnnotator::playAudio(const QString &audioTopic) {
 	// check for existence of topic
-	auto it = mAudioMsgs.find(audioTopic);
-	if (it == mAudioMsgs.end()) {
+	const int handle = mAudioMsgs.handle(audioTopic);
+	if (handle < 0 || mAudioMsgs[handle].isEmpty()) {
 		return;
 	}
 
+	const Timeline<int> &messages = mAudioMsgs[handle];
+
 	// check if audio has ended
-	if (it->rbegin()->first < mCurrentTime) {
+	if (messages.time(messages.size() - 1) < mCurrentTime) {
 		return;
 	}
 
 	// check if audio has started
-	auto currentIt = mCurrentAudio[audioTopic];
-	if (currentIt < it->begin()) {
+	const int current = mAudioMsgs.cursor(handle);
+	if (current < 0) {
 		return;
 	}
 
-	// seek to correct position when setting up the buffer
-	mAudioBuffer.setData(
-		mAudioByteArrays[audioTopic].constData() + currentIt->second, 
-		mAudioByteArrays[audioTopic].size() - currentIt->second
-	);
+	if (mAudioStream) {
+		mMediaPlayer.setMedia(QMediaContent());
+		mAudioStream.reset();
+	}
+
+	// Seeking only takes the time of the current message, from which the bag is streamed
+	mAudioStartTime = messages.time(current);
+	mAudioStream.reset(new AudioStream(mBagPath, audioTopic, mAudioStartTime));
+	if (!mAudioStream->open(QIODevice::ReadOnly)) {
+		mAudioStream.reset();
+		return;
+	}
 
-	mAudioBuffer.open(QIODevice::ReadOnly);
-	mMediaPlayer.setMedia(QMediaContent(), &mAudioBuffer);
+	mMediaPlayer.setMedia(QMediaContent(), mAudioStream.get());
+	// Whether the pitch is preserved depends on the multimedia backend
+	mMediaPlayer.setPlaybackRate(mRate);
 	mMediaPlayer.play();
 }
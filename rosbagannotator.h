@@ -2,7 +2,6 @@
 #define ROSBAGANNOTATOR_H
 
 #include <QQuickItem>
-#include <QBuffer>
 #include <QFileInfo>
 #include <QImage>
 #include <QMediaPlayer>
@@ -15,9 +14,18 @@ namespace rosbag {
 	class Bag;
 }
 
-#include <rosbag/message_instance.h>
-#include <sensor_msgs/CompressedImage.h>
-
+#include "bagparser.h"
+#include "messagecache.h"
+#include "framedecoder.h"
+#include "audiostream.h"
+#include "thumbnailbuilder.h"
+#include "thumbnailindex.h"
+#include "audioenvelopebuilder.h"
+#include "seriespyramid.h"
+#include "topicregistry.h"
+#include "annotationwriter.h"
+
+#include <algorithm>
 #include <memory>
 
 class RosBagAnnotator : public QQuickItem
@@ -28,13 +36,32 @@ class RosBagAnnotator : public QQuickItem
 	Q_PROPERTY(QString bagPath READ bagPath WRITE setBagPath NOTIFY bagPathChanged)
 	Q_PROPERTY(bool useRosTime READ useRosTime WRITE setUseRosTime NOTIFY useRosTimeChanged)
 	Q_PROPERTY(bool useSeparateBag READ useSeparateBag WRITE setUseSeparateBag NOTIFY useSeparateBagChanged)
+	Q_PROPERTY(bool windowedLoading READ windowedLoading WRITE setWindowedLoading NOTIFY windowedLoadingChanged)
+	Q_PROPERTY(int memoryBudget READ memoryBudget WRITE setMemoryBudget NOTIFY memoryBudgetChanged)
+	Q_PROPERTY(int parseThreads READ parseThreads WRITE setParseThreads NOTIFY parseThreadsChanged)
+	Q_PROPERTY(bool compressTimelines READ compressTimelines WRITE setCompressTimelines NOTIFY compressTimelinesChanged)
+	Q_PROPERTY(int frameCacheBudget READ frameCacheBudget WRITE setFrameCacheBudget NOTIFY frameCacheBudgetChanged)
+	Q_PROPERTY(int prefetchFrames READ prefetchFrames WRITE setPrefetchFrames NOTIFY prefetchFramesChanged)
+	Q_PROPERTY(QSize decodeSize READ decodeSize WRITE setDecodeSize NOTIFY decodeSizeChanged)
+	Q_PROPERTY(double thumbnailStride READ thumbnailStride WRITE setThumbnailStride NOTIFY thumbnailStrideChanged)
+	Q_PROPERTY(bool persistThumbnails READ persistThumbnails WRITE setPersistThumbnails NOTIFY persistThumbnailsChanged)
 	Q_PROPERTY(Status status READ status NOTIFY statusChanged)
 	Q_PROPERTY(double length READ length NOTIFY lengthChanged)
 	Q_PROPERTY(double currentTime READ currentTime WRITE setCurrentTime NOTIFY currentTimeChanged)
 	Q_PROPERTY(QVariantMap topics READ topics NOTIFY topicsChanged)
 	Q_PROPERTY(QVariantMap topicsByType READ topicsByType NOTIFY topicsByTypeChanged)
 	Q_PROPERTY(QVariantMap annotationTopics READ annotationTopics NOTIFY annotationTopicsChanged)
+	Q_PROPERTY(QVariantMap messageCounts READ messageCounts NOTIFY messageCountsChanged)
+	Q_PROPERTY(QVariantMap memorySavings READ memorySavings NOTIFY memorySavingsChanged)
+	Q_PROPERTY(QStringList topicFilter READ topicFilter NOTIFY topicFilterChanged)
+	Q_PROPERTY(QStringList subscribedTopics READ subscribedTopics WRITE setSubscribedTopics NOTIFY subscribedTopicsChanged)
 	Q_PROPERTY(bool playing READ playing NOTIFY playingChanged)
+	Q_PROPERTY(double drift READ drift NOTIFY driftChanged)
+	Q_PROPERTY(double rate READ rate WRITE setRate NOTIFY rateChanged)
+	Q_PROPERTY(int droppedFrames READ droppedFrames NOTIFY droppedFramesChanged)
+	Q_PROPERTY(double progress READ progress NOTIFY progressChanged)
+	Q_PROPERTY(double parseRate READ parseRate NOTIFY parseRateChanged)
+	Q_PROPERTY(double parseEta READ parseEta NOTIFY parseEtaChanged)
 
 public:
 	enum Status {
@@ -45,12 +72,12 @@ public:
 	Q_ENUM(Status)
 
 	enum AnnotationType {
-		BOOL,
-		INT,
-		DOUBLE,
-		STRING,
-		INT_ARRAY,
-		DOUBLE_ARRAY
+		BOOL = Annotations::BOOL,
+		INT = Annotations::INT,
+		DOUBLE = Annotations::DOUBLE,
+		STRING = Annotations::STRING,
+		INT_ARRAY = Annotations::INT_ARRAY,
+		DOUBLE_ARRAY = Annotations::DOUBLE_ARRAY
 	};
 	Q_ENUM(AnnotationType)
 
@@ -61,15 +88,38 @@ public:
 	const QString &bagPath() const { return mBagPath; }
 	bool useRosTime() const { return mUseRosTime; }
 	bool useSeparateBag() const { return mUseSeparateBag; }
+	bool windowedLoading() const { return mWindowedLoading; }
+	int memoryBudget() const { return mMessageCache.budget() / (1024 * 1024); }
+	int parseThreads() const { return mParseThreads; }
+	bool compressTimelines() const { return mCompressTimelines; }
+	int frameCacheBudget() const { return mFrameDecoder.budget() / (1024 * 1024); }
+	int prefetchFrames() const { return mPrefetchFrames; }
+	QSize decodeSize() const { return mFrameDecoder.scaledSize(); }
+	double thumbnailStride() const { return mThumbnailStride; }
+	bool persistThumbnails() const { return mPersistThumbnails; }
 	double length() const { return 1e-9 * (mEndTime - mStartTime); }
 	double currentTime() const { return 1e-9 * (mCurrentTime - mStartTime); }
 	const QVariantMap &topics() const { return mTopics; }
 	const QVariantMap &topicsByType() const { return mTopicsByType; }
-	bool playing() const { return mMediaPlayer.state() == QMediaPlayer::PlayingState; }
+	bool playing() const { return mPlaybackTimer.isActive() || mFrameConnection; }
+	// Seconds by which the playback clock was ahead of the audio clock before its last correction
+	double drift() const { return mDrift; }
+	double rate() const { return mRate; }
+	// Frames that playback went past before they were decoded, since it last started
+	int droppedFrames() const { return mDroppedFrames; }
 	const QVariantMap &annotationTopics() const { return mAnnotationTopics; }
+	const QVariantMap &messageCounts() const { return mMessageCounts; }
+	const QVariantMap &memorySavings() const { return mMemorySavings; }
+	const QStringList &topicFilter() const { return mTopicFilter; }
+	const QStringList &subscribedTopics() const { return mSubscribedTopics; }
+	double progress() const { return mProgress; }
+	double parseRate() const { return mParseRate; }
+	double parseEta() const { return mParseEta; }
 
 public slots:
 	void setBagPath(QString path);
+	void loadTopics(const QStringList &topics);
+	void cancelParse();
 	void setUseRosTime(bool use) {
 		mUseRosTime = use;
 		emit useRosTimeChanged(use);
@@ -78,201 +128,269 @@ public slots:
 		mUseSeparateBag = use;
 		emit useSeparateBagChanged(use);
 	}
+	// Takes effect the next time the bag is loaded
+	void setWindowedLoading(bool windowed) {
+		mWindowedLoading = windowed;
+		emit windowedLoadingChanged(windowed);
+	}
+	// In megabytes, for payloads instantiated on demand with windowed loading
+	void setMemoryBudget(int budget) {
+		mMessageCache.setBudget(static_cast<qint64>(budget) * 1024 * 1024);
+		emit memoryBudgetChanged(budget);
+	}
+	// Number of threads extracting messages, 0 for one per core
+	void setParseThreads(int threads) {
+		mParseThreads = threads;
+		emit parseThreadsChanged(threads);
+	}
+	// Takes effect the next time the bag is loaded
+	void setCompressTimelines(bool compress) {
+		mCompressTimelines = compress;
+		emit compressTimelinesChanged(compress);
+	}
+	// In megabytes, for decoded images
+	void setFrameCacheBudget(int budget) {
+		mFrameDecoder.setBudget(static_cast<qint64>(budget) * 1024 * 1024);
+		emit frameCacheBudgetChanged(budget);
+	}
+	// Number of images decoded ahead of the current one, in the direction the playhead last moved
+	void setPrefetchFrames(int frames) {
+		mPrefetchFrames = frames;
+		emit prefetchFramesChanged(frames);
+	}
+	// Images are decoded at the smallest size covering this one, or at full size when it is empty
+	void setDecodeSize(const QSize &size) {
+		mFrameDecoder.setScaledSize(size);
+		for (FrameState &state : mFrameStates) {
+			state.displayed.clear();
+		}
+		emit decodeSizeChanged(size);
+	}
+	// Takes effect the next time the bag is loaded, in seconds between thumbnails
+	void setThumbnailStride(double stride) {
+		mThumbnailStride = stride;
+		emit thumbnailStrideChanged(stride);
+	}
+	// Thumbnails are saved next to the bag, or in the cache directory if it is not writable
+	void setPersistThumbnails(bool persist) {
+		mPersistThumbnails = persist;
+		emit persistThumbnailsChanged(persist);
+	}
 
 	void setCurrentTime(double time);
 	void advance(double time);
 	void rewind(double time);
 
-	double findPreviousTime(const QString &topic);
-	double findNextTime(const QString &topic);
-
-	QVariant getCurrentValue(const QString &topic);
-
+	// Returns the id through which the topic is accessed by the calls below, or -1 if it has no
+	// timeline. Ids stay valid until the bag or a selection of its topics is loaded again.
+	int topicId(const QString &topic) const { return mRegistry.id(topic); }
+
+	double findPreviousTime(int topicId);
+	double findNextTime(int topicId);
+
+	QVariant getCurrentValue(int topicId);
+
+	// Subscribed topics are the ones displayed: only their current message is sought on every
+	// change of the current time, other topics are sought when they are next accessed. Values
+	// of subscribed topics are delivered through valuesChanged whenever their current message
+	// changes, and all of them at once by getCurrentValues, except for images, see frameReady.
+	void setSubscribedTopics(const QStringList &topics);
+	QVariantMap getCurrentValues();
+	// Returns a small preview of the image topic near time, while the thumbnails are being built
+	// only some of them are available
+	QVariant getThumbnail(const QString &topic, double time);
+	// Returns the frames of the image topics at the current time, either the last ones published
+	// before it or the nearest ones. Frames missing from the cache are decoded as one batch, the
+	// previous frame of their topic being returned until frameReady is emitted.
+	QVariantList getAlignedFrames(const QList<int> &topicIds, bool nearest);
+	// Returns the waveform of the audio topic between start and end, as at most maxBuckets
+	// buckets: their start and duration, along with lists of their min, max and rms. Envelopes
+	// are computed in the background, audioEnvelopeChanged is emitted as they grow.
+	QVariantMap getAudioEnvelope(const QString &topic, double start, double end, int maxBuckets);
+	// Returns a Double, Int, DoubleArray or IntArray topic between start and end downsampled to
+	// at most maxPoints points, each being the first, min, max and last value of one slice of
+	// the range. Values are packed doubles (Float64Array on the QML side) under "time", "first",
+	// "min", "max" and "last", one per point and component, along with the "components" count.
+	QVariantMap getSeries(int topicId, double start, double end, int maxPoints);
+
+	// Frequency is only used when the item is not shown in a window, see updatePlayback
 	void play(double frequency, const QString &audioTopic);
 	void stop();
+	// Speed of playback relative to real time, negative to play backwards. Audio is only heard
+	// at rates close enough to real time, see playAudio.
+	void setRate(double rate);
 
+	// Annotation calls return right away, annotations being written to the bag in batches, see
+	// AnnotationWriter. Arrays are given either as JS arrays or as the buffer of an Int32Array
+	// or a Float64Array.
 	void annotate(const QString &topic, const QVariant &value, AnnotationType type);
+	// Annotates the range from start to end with the same value, at rate messages per second.
+	// Ranges of more than ten million values in all, counting array elements, are refused.
+	void annotateRange(const QString &topic, double start, double end, const QVariant &value,
+					   AnnotationType type, double rate);
+	// Annotates each time, in seconds, with the value at the same index. Times are given as the
+	// buffer of a Float64Array, values as the buffer of a Uint8Array for BOOL, an Int32Array for
+	// INT and INT_ARRAY, or a Float64Array for DOUBLE and DOUBLE_ARRAY, arrays being packed one
+	// after the other, all with the same length. Strings are given as a JS array. Times are
+	// clamped to the bag.
+	void annotateBatch(const QString &topic, const QVariant &times, const QVariant &values, AnnotationType type);
 
 signals:
 	void statusChanged(Status status);
 	void bagPathChanged(const QString &path);
 	void useRosTimeChanged(bool use);
 	void useSeparateBagChanged(bool use);
+	void windowedLoadingChanged(bool windowed);
+	void memoryBudgetChanged(int budget);
+	void parseThreadsChanged(int threads);
+	void compressTimelinesChanged(bool compress);
+	void frameCacheBudgetChanged(int budget);
+	void prefetchFramesChanged(int frames);
+	void decodeSizeChanged(const QSize &size);
+	void thumbnailStrideChanged(double stride);
+	void persistThumbnailsChanged(bool persist);
 	void lengthChanged(double length);
 	void currentTimeChanged(double time);
 	void topicsChanged(const QVariantMap &topics);
 	void topicsByTypeChanged(const QVariantMap &topicsByType);
 	void playingChanged(bool playing);
+	void driftChanged(double drift);
+	void rateChanged(double rate);
+	void droppedFramesChanged(int droppedFrames);
 	void annotationTopicsChanged(const QVariantMap &annotationTopics);
+	void messageCountsChanged(const QVariantMap &messageCounts);
+	void memorySavingsChanged(const QVariantMap &memorySavings);
+	void topicFilterChanged(const QStringList &topicFilter);
+	void subscribedTopicsChanged(const QStringList &topics);
+	// Emitted after currentTimeChanged with the values of the subscribed topics whose current
+	// message is no longer the same, if any
+	void valuesChanged(const QVariantMap &values);
+	void progressChanged(double progress);
+	void parseRateChanged(double parseRate);
+	void parseEtaChanged(double parseEta);
+	// An image that was not decoded yet when requested through getCurrentValue is now available
+	void frameReady(const QString &topic, double time);
+	void audioEnvelopeChanged(const QString &topic);
+	// Annotations can no longer be journaled, so a crash may lose the latest ones
+	void annotationJournalFailed(const QString &path);
 
 private slots:
 	void updatePlayback();
+	void applyMetadata(const QVariantMap &topics, const QVariantMap &topicsByType,
+					   const QVariantMap &annotationTopics, const QVariantMap &messageCounts,
+					   quint64 startTime, quint64 endTime);
+	void updateParseProgress(double progress, double messagesPerSecond, double eta);
+	void finishParse();
+	void forwardFrame(const QString &topic, quint64 time);
+	void insertRecovered(const QString &topic, const Annotations &annotations);
 
 private:
 	void reset();
-	void parseBag();
-	void extractMessage(const rosbag::MessageInstance &msg);
-	void playAudio(const QString &audioTopic);
+	void clearMessages();
+	void startParse();
+	void stopParse();
+	void startThumbnails();
+	void stopThumbnails();
+	void startEnvelopes();
+	void stopEnvelopes();
+	void startAnnotationWriter();
+	void stopAnnotationWriter();
+	QString annotationBagPath() const;
+	void publishAnnotations(const QString &topic, const Annotations &annotations);
+	void insertAnnotations(const QString &topic, const Annotations &annotations);
+	void updateSubscriptions();
+	void publishChangedValues();
+	void mergeAnnotationTopics(const QVariantMap &annotationTopics);
 
-
-	template<class T>
-	uint64_t extractChiliMessageTime(const T msg) {
-		return msg->header.stamp;
-	}
-
-	template<class T>
-	void sortMessages(QMap<QString, QList<QPair<uint64_t, T>>> &typedMessages) {
-		for (auto it = typedMessages.begin(); it != typedMessages.end(); ++it) {
-			std::sort(it->begin(), it->end(), 
-				[&](const QPair<uint64_t, T> &a, const QPair<uint64_t, T> &b) {
-					return a.first < b.first;
-				}
-			);
-		}
-	}
-
-	template<class T>
-	void seekCurrentMessageIndices(const QMap<QString, QList<QPair<uint64_t, T>>> &typedMessages,
-								   QMap<QString, typename QList<QPair<uint64_t, T>>::const_iterator> &currentMessages) {
-		for (auto topicIt = typedMessages.begin(); topicIt != typedMessages.end(); ++topicIt) {
-			const QString &topic = topicIt.key();
-			const auto &messages = topicIt.value();
-			
-			auto currentIt = messages.begin() - 1;
-			if (currentMessages.find(topicIt.key()) != currentMessages.end()) {
-				currentIt = currentMessages[topic];
-			}
-
-			uint64_t prevTime = mStartTime;
-			if (currentIt >= messages.begin()) {
-				prevTime = currentIt->first;
-			}
-
-			if (prevTime < mCurrentTime) {
-				for (auto peekIt = currentIt + 1; peekIt != messages.end() && peekIt->first <= mCurrentTime; ++currentIt, ++peekIt);
-			}
-			else if (prevTime > mCurrentTime) {
-				for (; currentIt >= messages.begin() && currentIt->first > mCurrentTime; --currentIt);
-			}
-
-			currentMessages[topic] = currentIt;
-		}
-	}
-
-	template<class T>
-	uint64_t previousMessageTime(const QList<QPair<uint64_t, T>>& messages, typename QList<QPair<uint64_t, T>>::const_iterator current) {
-		if (current < messages.begin()) {
-			return mCurrentTime;
-		}
-
-		if (current->first < mCurrentTime) {
-			return current->first;
-		}
-
-		if (current > messages.begin()) {
-			current -= 1;
-		}
-
-		return current->first;
-	}
-
-	template<class T>
-	uint64_t nextMessageTime(const QList<QPair<uint64_t, T>>& messages, typename QList<QPair<uint64_t, T>>::const_iterator current) {
-		auto next = current + 1;
-		if (next == messages.end()) {
-			return mCurrentTime;
-		}
-		else {
-			return next->first;
-		}
-	}
-
-	template<class T>
-	void publishAnnotation(const QString &topic, const AnnotationType type, const T& msg) {
-		if (mStatus != READY) {
-			qDebug() << "Cannot publish annotation because bag isn't ready!";
-			return;
-		}
-
-		auto it = mAnnotationTopics.find(topic);
-		if (it != mAnnotationTopics.end()) {
-			if (it->value<AnnotationType>() != type) {
-				qDebug() << "Cannot publish different type to existing topic!";
-				return;
-			}
-		}
-		else {
-			mAnnotationTopics.insert(topic, type);
-			emit annotationTopicsChanged(mAnnotationTopics);
-		}
-
-		ros::Time time;
-		time.fromNSec(mCurrentTime);
-		std::string annotationTopic = ("/annotation/" + topic).toStdString();
-
-		QString annotationBagPath = mBagPath;
-		rosbag::bagmode::BagMode mode = rosbag::bagmode::Append;
-		if (mUseSeparateBag) {
-			annotationBagPath.replace(".bag", "-annotations.bag");
-
-			if (!QFileInfo::exists(annotationBagPath)) {
-				mode = rosbag::bagmode::Write;
-			}
-		}
-
-		try {
-			mAnnotationBag.reset(new rosbag::Bag());
-			mAnnotationBag->open(annotationBagPath.toStdString(), mode);
-			mAnnotationBag->write(annotationTopic, time, msg);
-			mAnnotationBag->close();
-		}
-		catch (const rosbag::BagException &e) {
-			qDebug() << "An exception ocurred while writing annotation to bag:" << e.what();
-		}
-	}
+	void playAudio(const QString &audioTopic);
+	ImagePtr imagePayload(int handle, int index);
+	void prefetchImages(int handle, int current);
+	// Frames shown and awaited by the views aligning frames one way. Views aligning them to the
+	// last message and to the nearest one each keep their own, so they do not take turns.
+	struct DisplayedFrame {
+		uint64_t time;
+		QImage image;
+	};
+	struct FrameState {
+		QHash<QString, DisplayedFrame> displayed;
+		// Time of the frame of each topic that playback is waiting for
+		QHash<QString, uint64_t> late;
+	};
+	void updateDisplayedFrame(FrameState &state, int handle, int index, QVector<FrameDecoder::Request> &requests);
+	QVariant displayedFrame(const FrameState &state, const QString &topic) const;
+	bool frameAwaited(const QString &topic, uint64_t time) const;
+
+	uint64_t previousMessageTime(const TopicRegistry::Entry &entry) const;
+	uint64_t nextMessageTime(const TopicRegistry::Entry &entry) const;
+
+	// A subscribed topic, resolved once and for all
+	struct Subscription {
+		QString topic;
+		TopicRegistry::Entry entry;
+		int lastCursor;
+	};
 
 	Status mStatus;
 	QString mBagPath;
-	std::unique_ptr<rosbag::Bag> mBag;
-	std::unique_ptr<rosbag::Bag> mAnnotationBag;
+	std::unique_ptr<BagParser> mParser;
+	std::unique_ptr<AnnotationWriter> mAnnotationWriter;
 	bool mUseRosTime;
 	bool mUseSeparateBag;
+	bool mWindowedLoading;
+	int mParseThreads;
+	bool mCompressTimelines;
+	int mPrefetchFrames;
+	double mThumbnailStride;
+	bool mPersistThumbnails;
 
 	uint64_t mStartTime;
 	uint64_t mEndTime;
 	uint64_t mCurrentTime;
 	uint64_t mPlaybackStartTime;
+	uint64_t mAudioStartTime;
+	int mSeekDirection;
+	double mDrift;
+	double mRate;
+	int mDroppedFrames;
+	qint64 mLastUpdateElapsed;
+	qint64 mFrameInterval;
+
+	double mProgress;
+	double mParseRate;
+	double mParseEta;
 
 	QTimer mPlaybackTimer;
+	QMetaObject::Connection mFrameConnection;
 	QElapsedTimer mPlaybackElapsedTimer;
 
 	QVariantMap mTopics;
 	QVariantMap mTopicsByType;
-
-	typedef sensor_msgs::CompressedImage::ConstPtr ImagePtr; 
-
-	QMap<QString, QList<QPair<uint64_t, bool>>::const_iterator> mCurrentBool;
-	QMap<QString, QList<QPair<uint64_t, double>>::const_iterator> mCurrentDouble;
-	QMap<QString, QList<QPair<uint64_t, int>>::const_iterator> mCurrentInt;
-	QMap<QString, QList<QPair<uint64_t, QString>>::const_iterator> mCurrentString;
-	QMap<QString, QList<QPair<uint64_t, QList<QVariant>>>::const_iterator> mCurrentIntArray;
-	QMap<QString, QList<QPair<uint64_t, QList<QVariant>>>::const_iterator> mCurrentDoubleArray;
-	QMap<QString, QList<QPair<uint64_t, int>>::const_iterator> mCurrentAudio;
-	QMap<QString, QList<QPair<uint64_t, ImagePtr>>::const_iterator> mCurrentImage;
-
-	QMap<QString, QList<QPair<uint64_t, bool>>> mBoolMsgs;
-	QMap<QString, QList<QPair<uint64_t, double>>> mDoubleMsgs;
-	QMap<QString, QList<QPair<uint64_t, int>>> mIntMsgs;
-	QMap<QString, QList<QPair<uint64_t, QString>>> mStringMsgs;
-	QMap<QString, QList<QPair<uint64_t, QList<QVariant>>>> mIntArrayMsgs;
-	QMap<QString, QList<QPair<uint64_t, QList<QVariant>>>> mDoubleArrayMsgs;
-	QMap<QString, QList<QPair<uint64_t, int>>> mAudioMsgs;
-	QMap<QString, QList<QPair<uint64_t, ImagePtr>>> mImageMsgs;
-
-	QMap<QString, QByteArray> mAudioByteArrays;
+	QVariantMap mMessageCounts;
+	QVariantMap mMemorySavings;
+	QStringList mTopicFilter;
+	QStringList mSubscribedTopics;
+	QVector<Subscription> mSubscriptions;
+
+	// Timelines of every message type
+	TopicRegistry mRegistry;
+	// Types that are played back through their own stores
+	TimelineStore<Timeline<ImagePtr>> &mImageMsgs;
+	TimelineStore<Timeline<int>> &mAudioMsgs;
+	TopicHandler *mImageHandler;
+
+	MessageCache mMessageCache;
+	FrameDecoder mFrameDecoder;
+	// Indexed by whether frames are aligned to the nearest message, see getAlignedFrames
+	FrameState mFrameStates[2];
+	ThumbnailIndex mThumbnails;
+	std::unique_ptr<ThumbnailBuilder> mThumbnailBuilder;
+	AudioEnvelopeBuilder::Envelopes mAudioEnvelopes;
+	// One pyramid per component of each topic plotted through getSeries, by topic id
+	QHash<int, QVector<SeriesPyramid>> mSeriesPyramids;
+	std::unique_ptr<AudioEnvelopeBuilder> mAudioEnvelopeBuilder;
 
 	QString mAudioTopic;
-	QBuffer mAudioBuffer;
+	std::unique_ptr<AudioStream> mAudioStream;
 	QMediaPlayer mMediaPlayer;
 
 	QVariantMap mAnnotationTopics;
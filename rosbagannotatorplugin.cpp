@@ -1,6 +1,7 @@
 #include "rosbagannotatorplugin.h"
 #include "rosbagannotator.h"
 #include "imageitem.h"
+#include "multiimageitem.h"
 
 #include <qqml.h>
 
@@ -9,4 +10,5 @@ void Qml_Rosbag_AnnotatorPlugin::registerTypes(const char *uri)
     // @uri ch.epfl.chili
     qmlRegisterType<RosBagAnnotator>(uri, 1, 0, "RosBagAnnotator");
     qmlRegisterType<ImageItem>(uri, 1, 0, "ImageItem");
+    qmlRegisterType<MultiImageItem>(uri, 1, 0, "MultiImageItem");
 }
@@ -0,0 +1,84 @@
+#ifndef SERIESPYRAMID_H
+#define SERIESPYRAMID_H
+
+#include <QVector>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Min and max of a numeric series, over blocks of FACTOR, FACTOR^2, ... consecutive values.
+// The min and max of any range of values then takes O(FACTOR log n) instead of O(n), which
+// is what plotting a long topic at a coarse zoom needs. Values themselves are not stored
+// but read through an accessor, and missing values are NaN, which min and max ignore.
+class SeriesPyramid
+{
+public:
+	enum {
+		FACTOR = 8
+	};
+
+	bool isEmpty() const { return mMin.isEmpty(); }
+
+	template<class Value>
+	void build(int count, Value value) {
+		mMin.clear();
+		mMax.clear();
+
+		int size = count;
+		while (size > 1) {
+			const int blocks = (size + FACTOR - 1) / FACTOR;
+			QVector<double> min(blocks, std::numeric_limits<double>::infinity());
+			QVector<double> max(blocks, -std::numeric_limits<double>::infinity());
+
+			const bool firstLevel = mMin.isEmpty();
+			for (int i = 0; i < size; ++i) {
+				const double lo = firstLevel ? value(i) : mMin.last()[i];
+				const double hi = firstLevel ? lo : mMax.last()[i];
+				min[i / FACTOR] = std::fmin(min[i / FACTOR], lo);
+				max[i / FACTOR] = std::fmax(max[i / FACTOR], hi);
+			}
+
+			mMin.append(min);
+			mMax.append(max);
+			size = blocks;
+		}
+	}
+
+	// Widens min and max by the values from first up to, but not including, last
+	template<class Value>
+	void range(int first, int last, Value value, double &min, double &max) const {
+		// Climbs to the largest blocks that are aligned and fit, and back down near the end
+		int level = 0;
+		int size = 1;
+		while (first < last) {
+			if (level < mMin.size() && first % (size * FACTOR) == 0 && first + size * FACTOR <= last) {
+				level += 1;
+				size *= FACTOR;
+			}
+			else if (first + size > last) {
+				level -= 1;
+				size /= FACTOR;
+			}
+			else {
+				if (level == 0) {
+					const double v = value(first);
+					min = std::fmin(min, v);
+					max = std::fmax(max, v);
+				}
+				else {
+					min = std::fmin(min, mMin[level - 1][first / size]);
+					max = std::fmax(max, mMax[level - 1][first / size]);
+				}
+				first += size;
+			}
+		}
+	}
+
+private:
+	// Level l holds blocks of FACTOR^(l + 1) values
+	QVector<QVector<double>> mMin;
+	QVector<QVector<double>> mMax;
+};
+
+#endif // SERIESPYRAMID_H
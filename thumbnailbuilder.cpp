@@ -0,0 +1,144 @@
+#include "thumbnailbuilder.h"
+#include "baglock.h"
+#include "indexcache.h"
+#include "rawimage.h"
+
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+
+#include <sensor_msgs/CompressedImage.h>
+#include <sensor_msgs/Image.h>
+
+#include <QBuffer>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QDebug>
+
+static const char *SUFFIX = ".annotator-thumbnails";
+
+// JPEG quality of the thumbnails
+static const int QUALITY = 75;
+
+ThumbnailBuilder::ThumbnailBuilder(const QString &bagPath, const QStringList &topics, uint64_t stride, bool persist,
+								   ThumbnailIndex *index, QObject *parent):
+	QThread(parent),
+	mBagPath(bagPath),
+	mTopics(topics),
+	mStride(stride),
+	mPersist(persist),
+	mIndex(index),
+	mCancelled(false)
+{
+}
+
+void ThumbnailBuilder::run() {
+	const QFileInfo info(mBagPath);
+	const QString path = IndexCache::sidecarPath(mBagPath, SUFFIX);
+	const QString key = QString("%1 %2 %3 %4").arg(info.size()).arg(info.lastModified().toMSecsSinceEpoch())
+		.arg(mStride).arg(HEIGHT);
+
+	if (mPersist) {
+		mIndex->load(path, key);
+	}
+
+	bool built = false;
+
+	try {
+		rosbag::Bag bag;
+		{
+			QReadLocker locker(&BagLock::instance());
+			bag.open(mBagPath.toStdString());
+		}
+
+		for (const QString &topic : mTopics) {
+			if (mCancelled) {
+				return;
+			}
+
+			// Topics loaded from the file are not saved again
+			if (mIndex->contains(topic)) {
+				continue;
+			}
+
+			if (!build(bag, topic)) {
+				return;
+			}
+			built = true;
+		}
+	}
+	catch (const rosbag::BagException &e) {
+		qDebug() << "An exception has occured while building thumbnails of bag " << mBagPath << ": " << e.what();
+		return;
+	}
+
+	if (built && mPersist) {
+		mIndex->save(path, key);
+	}
+}
+
+bool ThumbnailBuilder::build(rosbag::Bag &bag, const QString &topic) {
+	rosbag::View view(bag, rosbag::TopicQuery(topic.toStdString()));
+
+	// Messages in between are skipped through the bag index, without being read
+	uint64_t next = 0;
+	for (auto it = view.begin(); it != view.end(); ++it) {
+		if (mCancelled) {
+			return false;
+		}
+
+		const uint64_t time = it->getTime().toNSec();
+		if (time < next) {
+			continue;
+		}
+
+		const QByteArray jpeg = thumbnail(*it);
+		if (!jpeg.isEmpty()) {
+			mIndex->append(topic, time, jpeg);
+		}
+		next = time + mStride;
+	}
+
+	return true;
+}
+
+QByteArray ThumbnailBuilder::thumbnail(const rosbag::MessageInstance &msg) {
+	QImage image;
+
+	if (msg.getDataType() == "sensor_msgs/Image") {
+		image = RawImage::toQImage(msg.instantiate<sensor_msgs::Image>());
+	}
+	else {
+		sensor_msgs::CompressedImage::ConstPtr m = msg.instantiate<sensor_msgs::CompressedImage>();
+		if (!m) {
+			return QByteArray();
+		}
+
+		QByteArray bytes = QByteArray::fromRawData(reinterpret_cast<const char *>(m->data.data()), m->data.size());
+		QBuffer buffer(&bytes);
+		buffer.open(QIODevice::ReadOnly);
+
+		// JPEG frames are decoded at reduced resolution directly
+		QImageReader reader(&buffer, m->format.c_str());
+		const QSize size = reader.size();
+		if (size.isValid() && size.height() > HEIGHT && reader.supportsOption(QImageIOHandler::ScaledSize)) {
+			reader.setScaledSize(QSize(size.width() * HEIGHT / size.height(), HEIGHT));
+		}
+		image = reader.read();
+	}
+
+	if (image.isNull()) {
+		return QByteArray();
+	}
+
+	if (image.height() != HEIGHT) {
+		image = image.scaledToHeight(HEIGHT, Qt::SmoothTransformation);
+	}
+
+	QByteArray jpeg;
+	QBuffer buffer(&jpeg);
+	buffer.open(QIODevice::WriteOnly);
+	image.save(&buffer, "JPG", QUALITY);
+
+	return jpeg;
+}
@@ -0,0 +1,49 @@
+#ifndef THUMBNAILBUILDER_H
+#define THUMBNAILBUILDER_H
+
+#include <QThread>
+#include <QStringList>
+
+#include <rosbag/message_instance.h>
+
+#include <atomic>
+
+#include "thumbnailindex.h"
+
+namespace rosbag {
+	class Bag;
+}
+
+// Fills a ThumbnailIndex with one thumbnail per stride of each image topic, reading the bag
+// on its own low priority thread. Thumbnails are loaded from, and saved to, a file next to
+// the bag when persisting is enabled, so only topics missing from it are ever built.
+class ThumbnailBuilder : public QThread
+{
+	Q_OBJECT
+	Q_DISABLE_COPY(ThumbnailBuilder)
+
+public:
+	ThumbnailBuilder(const QString &bagPath, const QStringList &topics, uint64_t stride, bool persist,
+					 ThumbnailIndex *index, QObject *parent = nullptr);
+
+	void cancel() { mCancelled = true; }
+
+	// Height of the thumbnails, in pixels
+	static const int HEIGHT = 120;
+
+protected:
+	void run() override;
+
+private:
+	bool build(rosbag::Bag &bag, const QString &topic);
+	static QByteArray thumbnail(const rosbag::MessageInstance &msg);
+
+	QString mBagPath;
+	QStringList mTopics;
+	uint64_t mStride;
+	bool mPersist;
+	ThumbnailIndex *mIndex;
+	std::atomic<bool> mCancelled;
+};
+
+#endif // THUMBNAILBUILDER_H
@@ -0,0 +1,130 @@
+#include "thumbnailindex.h"
+
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QDebug>
+
+static const quint32 MAGIC = 0x52424154;
+static const quint32 VERSION = 1;
+
+ThumbnailIndex::ThumbnailIndex():
+	mLastIndex(-1)
+{
+}
+
+void ThumbnailIndex::clear() {
+	QMutexLocker locker(&mMutex);
+	mThumbnails.clear();
+	mLastTopic.clear();
+	mLastIndex = -1;
+	mLastImage = QImage();
+}
+
+void ThumbnailIndex::append(const QString &topic, uint64_t time, const QByteArray &thumbnail) {
+	QMutexLocker locker(&mMutex);
+	mThumbnails[topic].append(time, thumbnail);
+}
+
+bool ThumbnailIndex::contains(const QString &topic) const {
+	QMutexLocker locker(&mMutex);
+	return mThumbnails.contains(topic);
+}
+
+QImage ThumbnailIndex::nearest(const QString &topic, uint64_t time) const {
+	QMutexLocker locker(&mMutex);
+
+	auto it = mThumbnails.constFind(topic);
+	if (it == mThumbnails.constEnd() || it->isEmpty()) {
+		return QImage();
+	}
+
+	const Timeline<QByteArray> &thumbnails = *it;
+	int index = std::max(thumbnails.seek(time, -1), 0);
+	if (index + 1 < thumbnails.size() && thumbnails.time(index) <= time &&
+		thumbnails.time(index + 1) - time < time - thumbnails.time(index)) {
+		index += 1;
+	}
+
+	if (topic != mLastTopic || index != mLastIndex) {
+		mLastImage = QImage::fromData(thumbnails.value(index), "JPG");
+		mLastTopic = topic;
+		mLastIndex = index;
+	}
+
+	return mLastImage;
+}
+
+bool ThumbnailIndex::load(const QString &path, const QString &key) {
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_5_11);
+
+	quint32 magic, version, topicCount;
+	QString fileKey;
+	stream >> magic >> version >> fileKey >> topicCount;
+	if (stream.status() != QDataStream::Ok || magic != MAGIC || version != VERSION || fileKey != key) {
+		return false;
+	}
+
+	QHash<QString, Timeline<QByteArray>> loaded;
+	for (quint32 i = 0; i < topicCount && stream.status() == QDataStream::Ok; ++i) {
+		QString topic;
+		quint32 count;
+		stream >> topic >> count;
+
+		Timeline<QByteArray> &thumbnails = loaded[topic];
+		for (quint32 j = 0; j < count && stream.status() == QDataStream::Ok; ++j) {
+			quint64 time;
+			QByteArray thumbnail;
+			stream >> time >> thumbnail;
+			thumbnails.append(time, thumbnail);
+		}
+	}
+
+	if (stream.status() != QDataStream::Ok) {
+		qDebug() << "Ignoring truncated thumbnail file" << path;
+		return false;
+	}
+
+	QMutexLocker locker(&mMutex);
+	for (auto it = loaded.begin(); it != loaded.end(); ++it) {
+		mThumbnails.insert(it.key(), it.value());
+	}
+
+	return true;
+}
+
+bool ThumbnailIndex::save(const QString &path, const QString &key) const {
+	QDir().mkpath(QFileInfo(path).absolutePath());
+
+	QSaveFile file(path);
+	if (!file.open(QIODevice::WriteOnly)) {
+		qDebug() << "Could not write thumbnail file" << path;
+		return false;
+	}
+
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_5_11);
+
+	{
+		QMutexLocker locker(&mMutex);
+		stream << MAGIC << VERSION << key << static_cast<quint32>(mThumbnails.size());
+
+		for (auto it = mThumbnails.constBegin(); it != mThumbnails.constEnd(); ++it) {
+			stream << it.key() << static_cast<quint32>(it->size());
+			for (int i = 0; i < it->size(); ++i) {
+				stream << static_cast<quint64>(it->time(i)) << it->value(i);
+			}
+		}
+	}
+
+	return file.commit();
+}
@@ -0,0 +1,41 @@
+#ifndef THUMBNAILINDEX_H
+#define THUMBNAILINDEX_H
+
+#include <QString>
+#include <QByteArray>
+#include <QImage>
+#include <QHash>
+#include <QMutex>
+
+#include "timeline.h"
+
+// Low resolution thumbnails of image topics, stored as small JPEGs in time order. The index
+// is filled by a ThumbnailBuilder while it is being read, so every access is synchronized.
+class ThumbnailIndex
+{
+public:
+	ThumbnailIndex();
+
+	void clear();
+	void append(const QString &topic, uint64_t time, const QByteArray &thumbnail);
+	bool contains(const QString &topic) const;
+
+	// Returns the thumbnail of the topic closest to time, or a null image if there is none yet
+	QImage nearest(const QString &topic, uint64_t time) const;
+
+	// Topics are only loaded from files written with the same key, which identifies the bag
+	// and the parameters the thumbnails were made with
+	bool load(const QString &path, const QString &key);
+	bool save(const QString &path, const QString &key) const;
+
+private:
+	mutable QMutex mMutex;
+	QHash<QString, Timeline<QByteArray>> mThumbnails;
+
+	// Dragging along the timeline often stays on one thumbnail for several frames
+	mutable QString mLastTopic;
+	mutable int mLastIndex;
+	mutable QImage mLastImage;
+};
+
+#endif // THUMBNAILINDEX_H
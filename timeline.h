@@ -0,0 +1,805 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <QString>
+#include <QVector>
+#include <QHash>
+#include <QVariant>
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+// Returns the index of the last time at or before time, or -1 if there is none.
+// Moving forward from hint, as playback does in small steps, gallops from it in
+// exponentially growing steps. Moving backward is a binary search up to it.
+// Either way a seek costs O(log n) instead of walking the messages one at a time.
+inline int seekTime(const QVector<uint64_t> &times, uint64_t time, int hint) {
+	const uint64_t *begin = times.constData();
+	const uint64_t *end = begin + times.size();
+
+	if (hint >= times.size()) {
+		hint = times.size() - 1;
+	}
+
+	if (hint >= 0 && begin[hint] > time) {
+		return std::upper_bound(begin, begin + hint, time) - begin - 1;
+	}
+
+	// Every time before low is at or before time, high is either end or after time
+	const uint64_t *low = begin + hint + 1;
+	const uint64_t *high = low;
+	for (int step = 1; high != end && *high <= time; step *= 2) {
+		low = high + 1;
+		high = end - low > step ? low + step : end;
+	}
+
+	return std::upper_bound(low, high, time) - begin - 1;
+}
+
+// Returns the permutation that sorts times, keeping messages with equal times in order,
+// or an empty permutation when they already are sorted.
+inline std::vector<int> sortPermutation(const QVector<uint64_t> &times) {
+	std::vector<int> permutation;
+	if (std::is_sorted(times.begin(), times.end())) {
+		return permutation;
+	}
+
+	permutation.resize(times.size());
+	std::iota(permutation.begin(), permutation.end(), 0);
+	std::stable_sort(permutation.begin(), permutation.end(), [&](int a, int b) {
+		return times[a] < times[b];
+	});
+
+	return permutation;
+}
+
+// Timestamps of a timeline. They are plain absolute values until compressed, after which
+// they are split into blocks of BLOCK_SIZE timestamps, each starting with an absolute anchor
+// followed by the delta-of-deltas of the rest of the block as zigzag varints. Messages of a
+// steady-rate topic then take one or two bytes instead of eight, and a seek is a binary
+// search over the anchors followed by decoding a single block.
+class TimeColumn
+{
+public:
+	enum { BLOCK_SIZE = 128 };
+
+	TimeColumn():
+		mSize(0),
+		mLastTime(0),
+		mLastDelta(0),
+		mCompressed(false)
+	{
+	}
+
+	TimeColumn(const QVector<uint64_t> &times):
+		mTimes(times),
+		mSize(0),
+		mLastTime(0),
+		mLastDelta(0),
+		mCompressed(false)
+	{
+	}
+
+	int size() const { return mCompressed ? mSize : mTimes.size(); }
+	bool isEmpty() const { return size() == 0; }
+	bool isCompressed() const { return mCompressed; }
+
+	uint64_t at(int index) const {
+		if (!mCompressed) {
+			return mTimes[index];
+		}
+
+		const Block &block = mBlocks[index / BLOCK_SIZE];
+		const uchar *p = reinterpret_cast<const uchar *>(mBytes.constData()) + block.offset;
+		uint64_t time = block.anchor;
+		uint64_t delta = 0;
+		for (int i = index % BLOCK_SIZE; i > 0; --i) {
+			delta += readVarint(p);
+			time += delta;
+		}
+		return time;
+	}
+
+	int seek(uint64_t time, int hint) const {
+		if (!mCompressed) {
+			return seekTime(mTimes, time, hint);
+		}
+
+		auto block = std::upper_bound(mBlocks.begin(), mBlocks.end(), time, [](uint64_t time, const Block &block) {
+			return time < block.anchor;
+		});
+		if (block == mBlocks.begin()) {
+			return -1;
+		}
+		--block;
+
+		const int first = (block - mBlocks.begin()) * BLOCK_SIZE;
+		const int count = std::min<int>(BLOCK_SIZE, mSize - first);
+		const uchar *p = reinterpret_cast<const uchar *>(mBytes.constData()) + block->offset;
+		uint64_t current = block->anchor;
+		uint64_t delta = 0;
+		int index = first;
+		for (int i = 1; i < count; ++i) {
+			delta += readVarint(p);
+			current += delta;
+			if (current > time) {
+				break;
+			}
+			index = first + i;
+		}
+		return index;
+	}
+
+	void append(uint64_t time) {
+		if (!mCompressed) {
+			mTimes.append(time);
+			return;
+		}
+
+		if (mSize % BLOCK_SIZE == 0) {
+			Block block;
+			block.anchor = time;
+			block.offset = mBytes.size();
+			mBlocks.append(block);
+			mLastDelta = 0;
+		}
+		else {
+			const uint64_t delta = time - mLastTime;
+			writeVarint(mBytes, delta - mLastDelta);
+			mLastDelta = delta;
+		}
+
+		mLastTime = time;
+		++mSize;
+	}
+
+	void append(const TimeColumn &other) {
+		if (!mCompressed && !other.mCompressed) {
+			mTimes += other.mTimes;
+			return;
+		}
+
+		for (uint64_t time : other.toVector()) {
+			append(time);
+		}
+	}
+
+	void reserve(int size) {
+		if (!mCompressed) {
+			mTimes.reserve(size);
+		}
+	}
+
+	void squeeze() {
+		mTimes.squeeze();
+		mBlocks.squeeze();
+		mBytes.squeeze();
+	}
+
+	QVector<uint64_t> toVector() const {
+		if (!mCompressed) {
+			return mTimes;
+		}
+
+		QVector<uint64_t> times;
+		times.reserve(mSize);
+		for (int b = 0; b < mBlocks.size(); ++b) {
+			const int count = std::min<int>(BLOCK_SIZE, mSize - b * BLOCK_SIZE);
+			const uchar *p = reinterpret_cast<const uchar *>(mBytes.constData()) + mBlocks[b].offset;
+			uint64_t time = mBlocks[b].anchor;
+			uint64_t delta = 0;
+			times.append(time);
+			for (int i = 1; i < count; ++i) {
+				delta += readVarint(p);
+				time += delta;
+				times.append(time);
+			}
+		}
+		return times;
+	}
+
+	// Switches to the block encoding, unless it would not take less memory
+	void compress() {
+		if (mCompressed) {
+			return;
+		}
+
+		TimeColumn compressed;
+		compressed.mCompressed = true;
+		for (uint64_t time : mTimes) {
+			compressed.append(time);
+		}
+		compressed.squeeze();
+
+		if (compressed.memoryUsage() < memoryUsage()) {
+			std::swap(*this, compressed);
+		}
+	}
+
+	void decompress() {
+		if (!mCompressed) {
+			return;
+		}
+
+		*this = TimeColumn(toVector());
+	}
+
+	qint64 memoryUsage() const {
+		return mTimes.capacity() * sizeof(uint64_t) + mBlocks.capacity() * sizeof(Block) + mBytes.capacity();
+	}
+
+private:
+	struct Block {
+		uint64_t anchor;
+		quint32 offset;
+	};
+
+	// Differences are taken modulo 2^64, so timestamps that go backwards still round-trip
+	static void writeVarint(QByteArray &bytes, uint64_t value) {
+		uint64_t zigzag = (value << 1) ^ static_cast<uint64_t>(static_cast<int64_t>(value) >> 63);
+		while (zigzag >= 0x80) {
+			bytes.append(static_cast<char>(zigzag | 0x80));
+			zigzag >>= 7;
+		}
+		bytes.append(static_cast<char>(zigzag));
+	}
+
+	static uint64_t readVarint(const uchar *&p) {
+		uint64_t zigzag = 0;
+		for (int shift = 0; ; shift += 7) {
+			const uchar byte = *p++;
+			zigzag |= static_cast<uint64_t>(byte & 0x7f) << shift;
+			if (!(byte & 0x80)) {
+				break;
+			}
+		}
+		return (zigzag >> 1) ^ (~(zigzag & 1) + 1);
+	}
+
+	QVector<uint64_t> mTimes;
+
+	QVector<Block> mBlocks;
+	QByteArray mBytes;
+	int mSize;
+	uint64_t mLastTime;
+	uint64_t mLastDelta;
+	bool mCompressed;
+};
+
+// Values of a timeline, kept as they are
+template<class T>
+class ValueColumn
+{
+public:
+	ValueColumn() {}
+	ValueColumn(const QVector<T> &values):
+		mValues(values)
+	{
+	}
+
+	int size() const { return mValues.size(); }
+	const T &at(int index) const { return mValues[index]; }
+
+	void append(const T &value) { mValues.append(value); }
+	void append(const ValueColumn &other) { mValues += other.mValues; }
+	void reserve(int size) { mValues.reserve(size); }
+	void squeeze() { mValues.squeeze(); }
+
+	QVector<T> toVector() const { return mValues; }
+
+	void compress() {}
+
+	qint64 memoryUsage() const { return mValues.capacity() * sizeof(T); }
+
+private:
+	QVector<T> mValues;
+};
+
+// Strings are dictionary encoded once compressed: every distinct value is stored once,
+// and each message only holds the index of its value in the dictionary.
+template<>
+class ValueColumn<QString>
+{
+public:
+	ValueColumn():
+		mCompressed(false)
+	{
+	}
+
+	ValueColumn(const QVector<QString> &values):
+		mValues(values),
+		mCompressed(false)
+	{
+	}
+
+	int size() const { return mCompressed ? mIndices.size() : mValues.size(); }
+	const QString &at(int index) const { return mCompressed ? mDictionary[mIndices[index]] : mValues[index]; }
+
+	void append(const QString &value) {
+		if (!mCompressed) {
+			mValues.append(value);
+			return;
+		}
+
+		const quint32 index = mLookup.value(value, mDictionary.size());
+		if (index == static_cast<quint32>(mDictionary.size())) {
+			mLookup.insert(value, index);
+			mDictionary.append(value);
+		}
+		mIndices.append(index);
+	}
+
+	void append(const ValueColumn &other) {
+		if (!mCompressed && !other.mCompressed) {
+			mValues += other.mValues;
+			return;
+		}
+
+		for (int i = 0; i < other.size(); ++i) {
+			append(other.at(i));
+		}
+	}
+
+	void reserve(int size) {
+		if (mCompressed) {
+			mIndices.reserve(size);
+		}
+		else {
+			mValues.reserve(size);
+		}
+	}
+
+	void squeeze() {
+		mValues.squeeze();
+		mDictionary.squeeze();
+		mIndices.squeeze();
+	}
+
+	QVector<QString> toVector() const {
+		if (!mCompressed) {
+			return mValues;
+		}
+
+		QVector<QString> values;
+		values.reserve(mIndices.size());
+		for (quint32 index : mIndices) {
+			values.append(mDictionary[index]);
+		}
+		return values;
+	}
+
+	// Switches to the dictionary encoding, unless it would not take less memory
+	void compress() {
+		if (mCompressed) {
+			return;
+		}
+
+		ValueColumn compressed;
+		compressed.mCompressed = true;
+		compressed.mIndices.reserve(mValues.size());
+		for (const QString &value : mValues) {
+			compressed.append(value);
+		}
+		compressed.squeeze();
+
+		if (compressed.memoryUsage() < memoryUsage()) {
+			std::swap(*this, compressed);
+		}
+	}
+
+	qint64 memoryUsage() const {
+		// Each distinct value also has an entry in the lookup table, which holds a reference to its characters
+		return mValues.capacity() * sizeof(QString) + stringsUsage(mValues) +
+			mDictionary.capacity() * sizeof(QString) + stringsUsage(mDictionary) +
+			mIndices.capacity() * sizeof(quint32) +
+			mLookup.size() * (sizeof(QString) + sizeof(quint32) + 2 * sizeof(void *));
+	}
+
+private:
+	static qint64 stringsUsage(const QVector<QString> &strings) {
+		qint64 usage = 0;
+		for (const QString &string : strings) {
+			usage += sizeof(QArrayData) + (string.capacity() + 1) * sizeof(QChar);
+		}
+		return usage;
+	}
+
+	QVector<QString> mValues;
+
+	QVector<QString> mDictionary;
+	QVector<quint32> mIndices;
+	QHash<QString, quint32> mLookup;
+	bool mCompressed;
+};
+
+// Messages of one topic as contiguous columns of timestamps and values
+template<class T>
+class Timeline
+{
+public:
+	typedef T Value;
+
+	Timeline() {}
+	Timeline(const QVector<uint64_t> &times, const QVector<T> &values):
+		mTimes(times),
+		mValues(values)
+	{
+	}
+
+	int size() const { return mTimes.size(); }
+	bool isEmpty() const { return mTimes.isEmpty(); }
+	uint64_t time(int index) const { return mTimes.at(index); }
+	const T &value(int index) const { return mValues.at(index); }
+	QVariant variant(int index) const { return QVariant::fromValue(mValues.at(index)); }
+
+	QVector<uint64_t> times() const { return mTimes.toVector(); }
+	QVector<T> values() const { return mValues.toVector(); }
+
+	int seek(uint64_t time, int hint) const { return mTimes.seek(time, hint); }
+
+	void append(uint64_t time, const T &value) {
+		mTimes.append(time);
+		mValues.append(value);
+	}
+
+	void append(const Timeline &other) {
+		mTimes.append(other.mTimes);
+		mValues.append(other.mValues);
+	}
+
+	// Inserts the sorted messages of other after those at the same time, in a single pass over
+	// the timeline. Messages that all come after the last one are appended instead, which
+	// keeps a compressed timeline compressed, otherwise it is compressed again afterwards.
+	void merge(const Timeline &other) {
+		if (other.isEmpty()) {
+			return;
+		}
+
+		if (isEmpty() || other.time(0) >= time(size() - 1)) {
+			append(other);
+			return;
+		}
+
+		// Compressed timestamps are decoded once rather than block by block for each message
+		const QVector<uint64_t> times = mTimes.toVector();
+		const QVector<uint64_t> otherTimes = other.mTimes.toVector();
+
+		Timeline merged;
+		merged.reserve(times.size() + otherTimes.size());
+		int i = 0, j = 0;
+		while (i < times.size() || j < otherTimes.size()) {
+			if (j == otherTimes.size() || (i < times.size() && times[i] <= otherTimes[j])) {
+				merged.append(times[i], value(i));
+				++i;
+			}
+			else {
+				merged.append(otherTimes[j], other.value(j));
+				++j;
+			}
+		}
+
+		if (isCompressed()) {
+			merged.compress();
+		}
+		*this = merged;
+	}
+
+	void reserve(int size) {
+		mTimes.reserve(size);
+		mValues.reserve(size);
+	}
+
+	void squeeze() {
+		mTimes.squeeze();
+		mValues.squeeze();
+	}
+
+	void sort() {
+		const QVector<uint64_t> times = mTimes.toVector();
+		const std::vector<int> permutation = sortPermutation(times);
+		if (permutation.empty()) {
+			return;
+		}
+
+		Timeline sorted;
+		sorted.reserve(times.size());
+		for (int index : permutation) {
+			sorted.append(times[index], mValues.at(index));
+		}
+
+		if (isCompressed()) {
+			sorted.compress();
+		}
+		*this = sorted;
+	}
+
+	// Returns the number of bytes saved by compressing the timeline
+	qint64 compress() {
+		const qint64 usage = memoryUsage();
+		mTimes.compress();
+		mValues.compress();
+		return usage - memoryUsage();
+	}
+
+	bool isCompressed() const { return mTimes.isCompressed(); }
+
+	qint64 memoryUsage() const {
+		return mTimes.memoryUsage() + mValues.memoryUsage();
+	}
+
+private:
+	TimeColumn mTimes;
+	ValueColumn<T> mValues;
+};
+
+// Messages of one topic whose values are arrays: a column of timestamps, and the elements
+// of all arrays in one flat column along with the offset at which each array starts.
+template<class T>
+class ArrayTimeline
+{
+public:
+	typedef T Value;
+
+	ArrayTimeline():
+		mOffsets(1, 0)
+	{
+	}
+
+	ArrayTimeline(const QVector<uint64_t> &times, const QVector<int> &offsets, const QVector<T> &values):
+		mTimes(times),
+		mOffsets(offsets),
+		mValues(values)
+	{
+	}
+
+	int size() const { return mTimes.size(); }
+	bool isEmpty() const { return mTimes.isEmpty(); }
+	uint64_t time(int index) const { return mTimes.at(index); }
+	int count(int index) const { return mOffsets[index + 1] - mOffsets[index]; }
+	const T *data(int index) const { return mValues.constData() + mOffsets[index]; }
+
+	QVariant variant(int index) const {
+		QVariantList list;
+		list.reserve(count(index));
+		for (const T *it = data(index), *end = it + count(index); it != end; ++it) {
+			list.append(*it);
+		}
+		return list;
+	}
+
+	QVector<uint64_t> times() const { return mTimes.toVector(); }
+	const QVector<int> &offsets() const { return mOffsets; }
+	const QVector<T> &values() const { return mValues; }
+
+	int seek(uint64_t time, int hint) const { return mTimes.seek(time, hint); }
+
+	template<class Sequence>
+	void append(uint64_t time, const Sequence &values) {
+		mTimes.append(time);
+		for (const auto &value : values) {
+			mValues.append(static_cast<T>(value));
+		}
+		mOffsets.append(mValues.size());
+	}
+
+	void append(const ArrayTimeline &other) {
+		const int base = mValues.size();
+		mTimes.append(other.mTimes);
+		mValues += other.mValues;
+		for (int i = 1; i < other.mOffsets.size(); ++i) {
+			mOffsets.append(base + other.mOffsets[i]);
+		}
+	}
+
+	// Inserts the sorted messages of other after those at the same time, see Timeline::merge
+	void merge(const ArrayTimeline &other) {
+		if (other.isEmpty()) {
+			return;
+		}
+
+		if (isEmpty() || other.time(0) >= time(size() - 1)) {
+			append(other);
+			return;
+		}
+
+		const QVector<uint64_t> times = mTimes.toVector();
+		const QVector<uint64_t> otherTimes = other.mTimes.toVector();
+
+		ArrayTimeline merged;
+		merged.reserve(times.size() + otherTimes.size());
+		merged.mValues.reserve(mValues.size() + other.mValues.size());
+
+		auto take = [&merged](const ArrayTimeline &from, uint64_t time, int index) {
+			merged.mTimes.append(time);
+			for (const T *it = from.data(index), *end = it + from.count(index); it != end; ++it) {
+				merged.mValues.append(*it);
+			}
+			merged.mOffsets.append(merged.mValues.size());
+		};
+
+		int i = 0, j = 0;
+		while (i < times.size() || j < otherTimes.size()) {
+			if (j == otherTimes.size() || (i < times.size() && times[i] <= otherTimes[j])) {
+				take(*this, times[i], i);
+				++i;
+			}
+			else {
+				take(other, otherTimes[j], j);
+				++j;
+			}
+		}
+
+		if (isCompressed()) {
+			merged.compress();
+		}
+		*this = merged;
+	}
+
+	void reserve(int size) {
+		mTimes.reserve(size);
+		mOffsets.reserve(size + 1);
+	}
+
+	void squeeze() {
+		mTimes.squeeze();
+		mOffsets.squeeze();
+		mValues.squeeze();
+	}
+
+	void sort() {
+		const QVector<uint64_t> times = mTimes.toVector();
+		const std::vector<int> permutation = sortPermutation(times);
+		if (permutation.empty()) {
+			return;
+		}
+
+		ArrayTimeline sorted;
+		sorted.mTimes.reserve(times.size());
+		sorted.mOffsets.reserve(mOffsets.size());
+		sorted.mValues.reserve(mValues.size());
+
+		for (int index : permutation) {
+			sorted.mTimes.append(times[index]);
+			for (int i = mOffsets[index]; i < mOffsets[index + 1]; ++i) {
+				sorted.mValues.append(mValues[i]);
+			}
+			sorted.mOffsets.append(sorted.mValues.size());
+		}
+
+		if (isCompressed()) {
+			sorted.compress();
+		}
+		*this = sorted;
+	}
+
+	// Only the timestamps are compressed, elements are usually too varied to benefit from it
+	qint64 compress() {
+		const qint64 usage = memoryUsage();
+		mTimes.compress();
+		return usage - memoryUsage();
+	}
+
+	bool isCompressed() const { return mTimes.isCompressed(); }
+
+	qint64 memoryUsage() const {
+		return mTimes.memoryUsage() + mOffsets.capacity() * sizeof(int) + mValues.capacity() * sizeof(T);
+	}
+
+private:
+	TimeColumn mTimes;
+	QVector<int> mOffsets;
+	QVector<T> mValues;
+};
+
+// Timelines of every topic of one type, addressed by integer handles once their topic
+// has been looked up. Each timeline also has a cursor, the index of its last message at or
+// before the store's time. Moving the time only seeks the cursors of active timelines, the
+// others are brought up to date when they are next read, from wherever they were left.
+template<class TimelineType>
+class TimelineStore
+{
+public:
+	TimelineStore():
+		mTime(0)
+	{
+	}
+
+	int count() const { return mTimelines.size(); }
+	int handle(const QString &topic) const { return mHandles.value(topic, -1); }
+	bool contains(const QString &topic) const { return mHandles.contains(topic); }
+	const QString &topic(int handle) const { return mTopics[handle]; }
+
+	TimelineType &operator[](int handle) { return mTimelines[handle]; }
+	const TimelineType &operator[](int handle) const { return mTimelines[handle]; }
+
+	// Returns the timeline of the topic, adding an empty one if there is none yet
+	TimelineType &operator[](const QString &topic) { return mTimelines[insert(topic)]; }
+
+	int insert(const QString &topic) {
+		auto it = mHandles.constFind(topic);
+		if (it != mHandles.constEnd()) {
+			return it.value();
+		}
+
+		const int handle = mTimelines.size();
+		mHandles.insert(topic, handle);
+		mTopics.append(topic);
+		mTimelines.append(TimelineType());
+		mCursors.append(-1);
+		// Never sought yet
+		mCursorTimes.append(std::numeric_limits<uint64_t>::max());
+		return handle;
+	}
+
+	int cursor(int handle) const {
+		if (mCursorTimes[handle] != mTime) {
+			mCursors[handle] = mTimelines[handle].seek(mTime, mCursors[handle]);
+			mCursorTimes[handle] = mTime;
+		}
+		return mCursors[handle];
+	}
+
+	uint64_t time() const { return mTime; }
+
+	// Seeks the cursors of active timelines right away, the others lazily
+	void setTime(uint64_t time) {
+		mTime = time;
+		for (int handle : mActive) {
+			cursor(handle);
+		}
+	}
+
+	void setActive(int handle, bool active) {
+		const int index = mActive.indexOf(handle);
+		if (active && index < 0) {
+			mActive.append(handle);
+		}
+		else if (!active && index >= 0) {
+			mActive.remove(index);
+		}
+	}
+
+	void clearActive() { mActive.clear(); }
+
+	// Messages were inserted into the timeline, its cursor is sought again when next read
+	void invalidate(int handle) {
+		mCursors[handle] = -1;
+		mCursorTimes[handle] = std::numeric_limits<uint64_t>::max();
+		if (mActive.contains(handle)) {
+			cursor(handle);
+		}
+	}
+
+	void clear() {
+		mHandles.clear();
+		mTopics.clear();
+		mTimelines.clear();
+		mCursors.clear();
+		mCursorTimes.clear();
+		mActive.clear();
+	}
+
+	void swap(TimelineStore &other) {
+		mHandles.swap(other.mHandles);
+		mTopics.swap(other.mTopics);
+		mTimelines.swap(other.mTimelines);
+		mCursors.swap(other.mCursors);
+		mCursorTimes.swap(other.mCursorTimes);
+		mActive.swap(other.mActive);
+		std::swap(mTime, other.mTime);
+	}
+
+private:
+	QHash<QString, int> mHandles;
+	QVector<QString> mTopics;
+	QVector<TimelineType> mTimelines;
+	mutable QVector<int> mCursors;
+	mutable QVector<uint64_t> mCursorTimes;
+	QVector<int> mActive;
+	uint64_t mTime;
+};
+
+#endif // TIMELINE_H
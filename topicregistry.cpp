@@ -0,0 +1,240 @@
+#include "topicregistry.h"
+
+#include <rosbag/message_instance.h>
+
+#include <std_msgs/Bool.h>
+#include <std_msgs/Int32.h>
+#include <std_msgs/Float32.h>
+#include <std_msgs/Float64.h>
+#include <std_msgs/String.h>
+#include <std_msgs/Int32MultiArray.h>
+#include <std_msgs/Float32MultiArray.h>
+#include <std_msgs/Float64MultiArray.h>
+
+template<>
+QVariant TimelineHandler<Timeline<ImagePtr>>::value(int, int) const {
+	return QVariant();
+}
+
+namespace {
+
+// Appends the data field of a std_msgs message to the timeline of its topic
+template<class Message, class TimelineType>
+void appendData(TimelineStore<TimelineType> &store, const rosbag::MessageInstance &msg, uint64_t time) {
+	typename Message::ConstPtr m = msg.instantiate<Message>();
+	store[QString(msg.getTopic().c_str())].append(time, m->data);
+}
+
+class BoolHandler : public AnnotatedHandler<TimelineHandler<Timeline<bool>>, Annotations::BOOL>
+{
+public:
+	QString type() const override { return "Bool"; }
+	QStringList dataTypes() const override { return {"std_msgs/Bool"}; }
+
+	void extract(const rosbag::MessageInstance &msg, uint64_t time, bool) override {
+		appendData<std_msgs::Bool>(mStore, msg, time);
+	}
+};
+
+class IntHandler : public AnnotatedHandler<SeriesHandler<Timeline<int>>, Annotations::INT>
+{
+public:
+	QString type() const override { return "Int"; }
+	QStringList dataTypes() const override { return {"std_msgs/Int32"}; }
+
+	void extract(const rosbag::MessageInstance &msg, uint64_t time, bool) override {
+		appendData<std_msgs::Int32>(mStore, msg, time);
+	}
+};
+
+class DoubleHandler : public AnnotatedHandler<SeriesHandler<Timeline<double>>, Annotations::DOUBLE>
+{
+public:
+	QString type() const override { return "Double"; }
+	QStringList dataTypes() const override { return {"std_msgs/Float32", "std_msgs/Float64"}; }
+
+	void extract(const rosbag::MessageInstance &msg, uint64_t time, bool) override {
+		if (msg.getDataType() == "std_msgs/Float32") {
+			appendData<std_msgs::Float32>(mStore, msg, time);
+		}
+		else {
+			appendData<std_msgs::Float64>(mStore, msg, time);
+		}
+	}
+};
+
+class StringHandler : public AnnotatedHandler<TimelineHandler<Timeline<QString>>, Annotations::STRING>
+{
+public:
+	QString type() const override { return "String"; }
+	QStringList dataTypes() const override { return {"std_msgs/String"}; }
+
+	void extract(const rosbag::MessageInstance &msg, uint64_t time, bool) override {
+		std_msgs::String::ConstPtr m = msg.instantiate<std_msgs::String>();
+		mStore[QString(msg.getTopic().c_str())].append(time, m->data.c_str());
+	}
+};
+
+class IntArrayHandler : public AnnotatedHandler<SeriesHandler<ArrayTimeline<int>>, Annotations::INT_ARRAY>
+{
+public:
+	QString type() const override { return "IntArray"; }
+	QStringList dataTypes() const override { return {"std_msgs/Int32MultiArray"}; }
+
+	void extract(const rosbag::MessageInstance &msg, uint64_t time, bool) override {
+		appendData<std_msgs::Int32MultiArray>(mStore, msg, time);
+	}
+};
+
+class DoubleArrayHandler : public AnnotatedHandler<SeriesHandler<ArrayTimeline<double>>, Annotations::DOUBLE_ARRAY>
+{
+public:
+	QString type() const override { return "DoubleArray"; }
+	QStringList dataTypes() const override { return {"std_msgs/Float32MultiArray", "std_msgs/Float64MultiArray"}; }
+
+	void extract(const rosbag::MessageInstance &msg, uint64_t time, bool) override {
+		if (msg.getDataType() == "std_msgs/Float32MultiArray") {
+			appendData<std_msgs::Float32MultiArray>(mStore, msg, time);
+		}
+		else {
+			appendData<std_msgs::Float64MultiArray>(mStore, msg, time);
+		}
+	}
+};
+
+// Values are payload sizes in bytes, the audio itself being streamed from the bag, see AudioStream
+class AudioHandler : public TimelineHandler<Timeline<int>>
+{
+public:
+	QString type() const override { return "Audio"; }
+	QStringList dataTypes() const override { return {"audio_common_msgs/AudioData"}; }
+
+	void extract(const rosbag::MessageInstance &msg, uint64_t time, bool) override {
+		// The payload is a single uint8[], serialized after its 4 byte length
+		mStore[QString(msg.getTopic().c_str())].append(time, static_cast<int>(msg.size() - sizeof(uint32_t)));
+	}
+};
+
+// Payloads are null for images that were parsed with windowed loading
+class ImageHandler : public TimelineHandler<Timeline<ImagePtr>>
+{
+public:
+	QString type() const override { return "Image"; }
+	QStringList dataTypes() const override { return {"sensor_msgs/CompressedImage", "sensor_msgs/Image"}; }
+	bool resident() const override { return true; }
+
+	void extract(const rosbag::MessageInstance &msg, uint64_t time, bool windowed) override {
+		const QString topic(msg.getTopic().c_str());
+
+		// With windowed loading, only the timestamp is kept and the payload is read again when displayed
+		if (msg.getDataType() == "sensor_msgs/CompressedImage") {
+			sensor_msgs::CompressedImage::ConstPtr m;
+			if (!windowed) {
+				m = msg.instantiate<sensor_msgs::CompressedImage>();
+			}
+			mStore[topic].append(time, m);
+		}
+		else {
+			sensor_msgs::Image::ConstPtr m;
+			if (!windowed) {
+				m = msg.instantiate<sensor_msgs::Image>();
+			}
+			mStore[topic].append(time, m);
+		}
+	}
+};
+
+}
+
+TopicRegistry::TopicRegistry() {
+	addType(new BoolHandler());
+	addType(new IntHandler());
+	addType(new DoubleHandler());
+	addType(new StringHandler());
+	addType(new IntArrayHandler());
+	addType(new DoubleArrayHandler());
+	addType(new AudioHandler());
+	addType(new ImageHandler());
+}
+
+void TopicRegistry::addType(TopicHandler *handler) {
+	mHandlers.emplace_back(handler);
+	mTypes.insert(handler->type(), handler);
+	for (const QString &dataType : handler->dataTypes()) {
+		mDataTypes[dataType.toStdString()] = handler;
+	}
+}
+
+TopicHandler *TopicRegistry::handlerOf(const std::string &dataType) const {
+	auto it = mDataTypes.find(dataType);
+	return it == mDataTypes.end() ? nullptr : it->second;
+}
+
+TopicHandler *TopicRegistry::annotationHandler(Annotations::Type type) const {
+	for (const auto &handler : mHandlers) {
+		if (handler->annotates(type)) {
+			return handler.get();
+		}
+	}
+	return nullptr;
+}
+
+void TopicRegistry::resolve(const QVariantMap &topics) {
+	for (auto it = topics.begin(); it != topics.end(); ++it) {
+		TopicHandler *handler = mTypes.value(it.value().toString(), nullptr);
+		if (!handler) {
+			continue;
+		}
+
+		const int handle = handler->handle(it.key());
+		if (handle < 0) {
+			continue;
+		}
+
+		Entry entry;
+		entry.handler = handler;
+		entry.handle = handle;
+
+		auto id = mIds.constFind(it.key());
+		if (id != mIds.constEnd()) {
+			mEntries[id.value()] = entry;
+		}
+		else {
+			mIds.insert(it.key(), mEntries.size());
+			mEntries.append(entry);
+		}
+	}
+}
+
+void TopicRegistry::setTime(uint64_t time) {
+	for (const auto &handler : mHandlers) {
+		handler->setTime(time);
+	}
+}
+
+void TopicRegistry::clearActive() {
+	for (const auto &handler : mHandlers) {
+		handler->clearActive();
+	}
+}
+
+void TopicRegistry::clear() {
+	for (const auto &handler : mHandlers) {
+		handler->clear();
+	}
+
+	mIds.clear();
+	mEntries.clear();
+}
+
+void TopicRegistry::swap(TopicRegistry &other) {
+	// Both registries hold the same types in the same order
+	for (size_t i = 0; i < mHandlers.size(); ++i) {
+		mHandlers[i]->swap(*other.mHandlers[i]);
+	}
+
+	mIds.clear();
+	mEntries.clear();
+	other.mIds.clear();
+	other.mEntries.clear();
+}
@@ -0,0 +1,383 @@
+#ifndef TOPICREGISTRY_H
+#define TOPICREGISTRY_H
+
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+#include <QHash>
+#include <QVector>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "timeline.h"
+#include "seriespyramid.h"
+#include "annotations.h"
+#include "indexcache.h"
+#include "imageptr.h"
+
+namespace rosbag {
+	class MessageInstance;
+}
+
+// Timelines of one message type in their TimelineStore, along with everything that depends
+// on their type: extracting messages, storing them in the index cache, inserting annotations.
+// Callers access them through the handles of the store without having to know their type.
+class TopicHandler
+{
+public:
+	virtual ~TopicHandler() {}
+
+	// Name of the message type exposed to QML
+	virtual QString type() const = 0;
+	// ROS datatypes of the messages extracted into this type
+	virtual QStringList dataTypes() const = 0;
+	// Whether payloads are held by the timelines, which then cannot be restored from the index
+	// cache unless they are loaded on demand, see IndexCache::load
+	virtual bool resident() const { return false; }
+
+	virtual int count() const = 0;
+	virtual const QString &topic(int handle) const = 0;
+	virtual int handle(const QString &topic) const = 0;
+	virtual int insert(const QString &topic) = 0;
+	virtual int size(int handle) const = 0;
+	virtual uint64_t time(int handle, int index) const = 0;
+	virtual QVariant value(int handle, int index) const = 0;
+	virtual int cursor(int handle) const = 0;
+
+	virtual void setTime(uint64_t time) = 0;
+	virtual void setActive(int handle, bool active) = 0;
+	virtual void clearActive() = 0;
+
+	virtual void clear() = 0;
+	// Other is a handler of the same type
+	virtual void swap(TopicHandler &other) = 0;
+
+	// Appends the message to the timeline of its topic. With windowed loading, payloads are
+	// left for MessageCache to read when they are needed.
+	virtual void extract(const rosbag::MessageInstance &msg, uint64_t time, bool windowed) = 0;
+	// Appends the timelines of the topic from parts, handlers of the same type holding later
+	// messages, see BagParser::mergeExtractions. Topics are independent of each other.
+	virtual void concatenate(int handle, const QVector<const TopicHandler *> &parts) = 0;
+	virtual void sort(int handle) = 0;
+	// Returns the number of bytes saved
+	virtual qint64 compress(int handle) = 0;
+
+	// Writes the topic, type, timestamps and columns of every timeline, see IndexCache
+	virtual void save(IndexCacheWriter &writer) const = 0;
+	// Reads back the columns of a timeline whose topic, type and timestamps were read
+	virtual bool load(IndexCacheReader &reader, const QString &topic, const QVector<uint64_t> &times) = 0;
+
+	// Returns whether annotations of the type are inserted into timelines of this type
+	virtual bool annotates(Annotations::Type type) const {
+		Q_UNUSED(type);
+		return false;
+	}
+	// Merges the annotations into the timeline of the topic and returns its handle
+	virtual int annotate(const QString &topic, const Annotations &annotations) {
+		Q_UNUSED(topic);
+		Q_UNUSED(annotations);
+		return -1;
+	}
+
+	// Returns the timeline between start and end downsampled to at most maxPoints points, see
+	// RosBagAnnotator::getSeries, or an empty map for types that cannot be plotted. Pyramids
+	// are built on first use, one per component, and reused afterwards.
+	virtual QVariantMap series(int handle, QVector<SeriesPyramid> &pyramids, uint64_t start, uint64_t end,
+							   int maxPoints, uint64_t origin) const {
+		Q_UNUSED(handle);
+		Q_UNUSED(pyramids);
+		Q_UNUSED(start);
+		Q_UNUSED(end);
+		Q_UNUSED(maxPoints);
+		Q_UNUSED(origin);
+		return QVariantMap();
+	}
+};
+
+// Everything that only depends on the timeline type, message types only adding their name
+// and how their messages are extracted
+template<class TimelineType>
+class TimelineHandler : public TopicHandler
+{
+public:
+	TimelineStore<TimelineType> &store() { return mStore; }
+	// Reading through the const store does not detach its timelines
+	const TimelineStore<TimelineType> &store() const { return mStore; }
+
+	int count() const override { return mStore.count(); }
+	const QString &topic(int handle) const override { return mStore.topic(handle); }
+	int handle(const QString &topic) const override { return mStore.handle(topic); }
+	int insert(const QString &topic) override { return mStore.insert(topic); }
+	int size(int handle) const override { return store()[handle].size(); }
+	uint64_t time(int handle, int index) const override { return store()[handle].time(index); }
+	QVariant value(int handle, int index) const override { return store()[handle].variant(index); }
+	int cursor(int handle) const override { return mStore.cursor(handle); }
+
+	void setTime(uint64_t time) override { mStore.setTime(time); }
+	void setActive(int handle, bool active) override { mStore.setActive(handle, active); }
+	void clearActive() override { mStore.clearActive(); }
+
+	void clear() override { mStore.clear(); }
+	void swap(TopicHandler &other) override { mStore.swap(static_cast<TimelineHandler &>(other).mStore); }
+
+	void concatenate(int handle, const QVector<const TopicHandler *> &parts) override {
+		TimelineType &messages = mStore[handle];
+		const QString &topic = mStore.topic(handle);
+
+		int size = messages.size();
+		for (const TopicHandler *part : parts) {
+			const TimelineStore<TimelineType> &partMessages = static_cast<const TimelineHandler *>(part)->mStore;
+			const int partHandle = partMessages.handle(topic);
+			if (partHandle >= 0) {
+				size += partMessages[partHandle].size();
+			}
+		}
+		messages.reserve(size);
+
+		for (const TopicHandler *part : parts) {
+			const TimelineStore<TimelineType> &partMessages = static_cast<const TimelineHandler *>(part)->mStore;
+			const int partHandle = partMessages.handle(topic);
+			if (partHandle >= 0) {
+				messages.append(partMessages[partHandle]);
+			}
+		}
+	}
+
+	void sort(int handle) override { mStore[handle].sort(); }
+	qint64 compress(int handle) override { return mStore[handle].compress(); }
+
+	void save(IndexCacheWriter &writer) const override {
+		for (int handle = 0; handle < mStore.count(); ++handle) {
+			const TimelineType &messages = mStore[handle];
+			const QVector<uint64_t> times = messages.times();
+
+			writer.writeString(mStore.topic(handle).toUtf8());
+			writer.writeString(type().toUtf8());
+			writer.write<quint64>(times.size());
+			writer.writeArray(times.constData(), times.size());
+			IndexCacheColumns<TimelineType>::save(writer, messages);
+		}
+	}
+
+	bool load(IndexCacheReader &reader, const QString &topic, const QVector<uint64_t> &times) override {
+		return IndexCacheColumns<TimelineType>::load(reader, times, mStore[topic]);
+	}
+
+protected:
+	TimelineStore<TimelineType> mStore;
+};
+
+// Images are decoded before being displayed, see RosBagAnnotator::getCurrentValue
+template<>
+QVariant TimelineHandler<Timeline<ImagePtr>>::value(int handle, int index) const;
+
+// Timelines of a type that annotations of the given type are merged into. Annotations are
+// merged in a single pass per batch, sorted first since annotateBatch takes times in any order.
+template<class Base, Annotations::Type AnnotatedType>
+class AnnotatedHandler : public Base
+{
+public:
+	bool annotates(Annotations::Type type) const override { return type == AnnotatedType; }
+
+	int annotate(const QString &topic, const Annotations &annotations) override {
+		const int handle = this->mStore.insert(topic);
+		merge(this->mStore[handle], annotations);
+
+		// Indices after the first merged message have moved
+		this->mStore.invalidate(handle);
+		return handle;
+	}
+
+private:
+	template<class T>
+	static void merge(Timeline<T> &messages, const Annotations &annotations) {
+		const auto &column = AnnotationColumn<T>::of(annotations);
+
+		Timeline<T> batch;
+		batch.reserve(annotations.size());
+		for (int row = 0; row < annotations.size(); ++row) {
+			batch.append(annotations.times[row], static_cast<T>(column[row]));
+		}
+		batch.sort();
+
+		messages.merge(batch);
+	}
+
+	template<class T>
+	static void merge(ArrayTimeline<T> &messages, const Annotations &annotations) {
+		const auto &column = AnnotationColumn<T>::of(annotations);
+
+		QVector<int> offsets;
+		offsets.reserve(annotations.size() + 1);
+		for (int row = 0; row <= annotations.size(); ++row) {
+			offsets.append(row * annotations.length);
+		}
+
+		QVector<T> values;
+		values.reserve(column.size());
+		for (const auto &value : column) {
+			values.append(static_cast<T>(value));
+		}
+
+		ArrayTimeline<T> batch(annotations.times, offsets, values);
+		batch.sort();
+
+		messages.merge(batch);
+	}
+};
+
+// Numeric view of the messages of a timeline, one specialization per plottable timeline type.
+// Value returns the component of the message at index, or NaN if it has none.
+template<class TimelineType>
+struct SeriesValues;
+
+template<class T>
+struct SeriesValues<Timeline<T>>
+{
+	static int components(const Timeline<T> &) { return 1; }
+	static double value(const Timeline<T> &messages, int index, int) { return static_cast<double>(messages.value(index)); }
+};
+
+// Arrays are plotted per component, up to the longest array of the topic
+template<class T>
+struct SeriesValues<ArrayTimeline<T>>
+{
+	static int components(const ArrayTimeline<T> &messages) {
+		int count = 0;
+		for (int i = 0; i < messages.size(); ++i) {
+			count = std::max(count, messages.count(i));
+		}
+		return count;
+	}
+
+	static double value(const ArrayTimeline<T> &messages, int index, int component) {
+		return component < messages.count(index) ? static_cast<double>(messages.data(index)[component]) : std::nan("");
+	}
+};
+
+template<class TimelineType>
+class SeriesHandler : public TimelineHandler<TimelineType>
+{
+public:
+	QVariantMap series(int handle, QVector<SeriesPyramid> &pyramids, uint64_t start, uint64_t end,
+					   int maxPoints, uint64_t origin) const override {
+		typedef SeriesValues<TimelineType> Values;
+		const TimelineType &messages = this->store()[handle];
+
+		// Pyramids are only built for topics that are plotted
+		if (pyramids.isEmpty()) {
+			const int components = Values::components(messages);
+			pyramids.resize(components);
+			for (int component = 0; component < components; ++component) {
+				pyramids[component].build(messages.size(), [&](int index) {
+					return Values::value(messages, index, component);
+				});
+			}
+		}
+		const int components = pyramids.size();
+
+		QVector<double> times, first, min, max, last;
+		const int endIndex = messages.seek(end, -1) + 1;
+		int index = start > 0 ? messages.seek(start - 1, -1) + 1 : 0;
+
+		// Slices without messages are skipped, so the work depends on the points, not the messages
+		const uint64_t width = std::max<uint64_t>((end - start) / maxPoints + 1, 1);
+		while (index < endIndex) {
+			const uint64_t sliceEnd = start + ((messages.time(index) - start) / width + 1) * width;
+			const int next = std::min(messages.seek(sliceEnd - 1, index) + 1, endIndex);
+
+			times.append(1e-9 * (messages.time(index) - origin));
+			for (int component = 0; component < components; ++component) {
+				double lo = std::numeric_limits<double>::infinity();
+				double hi = -std::numeric_limits<double>::infinity();
+				pyramids[component].range(index, next, [&](int i) {
+					return Values::value(messages, i, component);
+				}, lo, hi);
+
+				first.append(Values::value(messages, index, component));
+				min.append(lo);
+				max.append(hi);
+				last.append(Values::value(messages, next - 1, component));
+			}
+
+			index = next;
+		}
+
+		auto pack = [](const QVector<double> &values) {
+			return QByteArray(reinterpret_cast<const char *>(values.constData()), values.size() * sizeof(double));
+		};
+
+		QVariantMap series;
+		series.insert("components", components);
+		series.insert("time", pack(times));
+		series.insert("first", pack(first));
+		series.insert("min", pack(min));
+		series.insert("max", pack(max));
+		series.insert("last", pack(last));
+		return series;
+	}
+};
+
+// Handlers of every message type, see topicregistry.cpp, and the topics resolved to the handler
+// of their type and the handle of their timeline. Resolved topics are given integer ids, so that
+// accessing one costs an index and a virtual call. Supporting a new message type takes a handler
+// registered by the constructor, which provides everything that depends on the type.
+class TopicRegistry
+{
+	Q_DISABLE_COPY(TopicRegistry)
+
+public:
+	struct Entry {
+		TopicHandler *handler;
+		int handle;
+	};
+
+	TopicRegistry();
+
+	const std::vector<std::unique_ptr<TopicHandler>> &handlers() const { return mHandlers; }
+	// Returns null for unknown types
+	TopicHandler *handler(const QString &type) const { return mTypes.value(type, nullptr); }
+	TopicHandler *handlerOf(const std::string &dataType) const;
+	TopicHandler *annotationHandler(Annotations::Type type) const;
+
+	// Store of the handler of type, whose timelines are of type TimelineType
+	template<class TimelineType>
+	TimelineStore<TimelineType> &store(const QString &type) {
+		TimelineHandler<TimelineType> *typed = dynamic_cast<TimelineHandler<TimelineType> *>(handler(type));
+		Q_ASSERT(typed);
+		return typed->store();
+	}
+
+	// Resolves the topics of a map from topic to type name, those without a timeline are skipped.
+	// Topics that were already resolved keep their id.
+	void resolve(const QVariantMap &topics);
+	// Returns -1 if the topic was not resolved
+	int id(const QString &topic) const { return mIds.value(topic, -1); }
+	// Returns null if no topic has the id
+	const Entry *entry(int id) const { return id >= 0 && id < mEntries.size() ? &mEntries[id] : nullptr; }
+	const Entry *find(const QString &topic) const { return entry(id(topic)); }
+
+	void setTime(uint64_t time);
+	void clearActive();
+	// Clears the timelines of every type, which invalidates ids
+	void clear();
+	// Swaps the timelines of every type with those of other, ids of both have to be resolved again
+	void swap(TopicRegistry &other);
+
+private:
+	void addType(TopicHandler *handler);
+
+	std::vector<std::unique_ptr<TopicHandler>> mHandlers;
+	QHash<QString, TopicHandler *> mTypes;
+	std::unordered_map<std::string, TopicHandler *> mDataTypes;
+	QHash<QString, int> mIds;
+	QVector<Entry> mEntries;
+};
+
+#endif // TOPICREGISTRY_H